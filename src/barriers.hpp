@@ -0,0 +1,269 @@
+#ifndef BARRIERS_HPP
+#define BARRIERS_HPP
+
+#include <ff/barrier.hpp>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Barrier used by the workers at the end of each generation
+ */
+class WorkerBarrier {
+    public:
+    virtual ~WorkerBarrier(){}
+
+    /**
+     * Blocks worker id until all the workers have reached the barrier
+     */
+    virtual void doBarrier(int const& id)=0;
+};
+
+/**
+ * The FastFlow barrier, whose waiting behaviour depends on how FastFlow is built
+ */
+class FFWorkerBarrier : public WorkerBarrier {
+    ff::Barrier ba;
+
+    public:
+    FFWorkerBarrier(int nworkers){
+        ba.barrierSetup(nworkers);
+    }
+
+    void doBarrier(int const& id){
+        ba.doBarrier(id);
+    }
+};
+
+/**
+ * Spin-then-block wait on a flag: spins for a number of iterations, then
+ * sleeps on a futex until the flag is changed by release()
+ */
+class SpinThenBlock {
+    int _spin; //iterations before blocking, negative to never block
+    std::atomic<int> sleepers{0};
+
+    static inline void pause(){
+        #if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+        #endif
+    }
+
+    public:
+    SpinThenBlock(int spin) : _spin(spin){}
+
+    /**
+     * Waits while the flag is equal to old
+     */
+    inline void await(std::atomic<int>& flag, int const& old){
+        for(int i=0; _spin < 0 || i < _spin; i++){
+            if(flag.load(std::memory_order_acquire) != old) return;
+            pause();
+        }
+        sleepers.fetch_add(1);
+        while(flag.load() == old){
+            syscall(SYS_futex, reinterpret_cast<int*>(&flag), FUTEX_WAIT_PRIVATE, old,
+                    nullptr, nullptr, 0);
+        }
+        sleepers.fetch_sub(1);
+    }
+
+    /**
+     * Sets the flag and wakes up the threads sleeping on it
+     */
+    inline void release(std::atomic<int>& flag, int const& value){
+        flag.store(value);
+        wake(flag);
+    }
+
+    /**
+     * Increments the flag, for flags changed by several threads, and wakes up
+     * the threads sleeping on it
+     */
+    inline void bump(std::atomic<int>& flag){
+        flag.fetch_add(1);
+        wake(flag);
+    }
+
+    private:
+    inline void wake(std::atomic<int>& flag){
+        if(sleepers.load() > 0){
+            syscall(SYS_futex, reinterpret_cast<int*>(&flag), FUTEX_WAKE_PRIVATE, INT_MAX,
+                    nullptr, nullptr, 0);
+        }
+    }
+};
+
+/**
+ * Centralized sense-reversing barrier: the last worker to arrive flips the
+ * global sense, the others wait for it with the spin-then-block policy
+ */
+class SenseBarrier : public WorkerBarrier {
+    struct alignas(64) padded {
+        int sense = 0;
+    };
+
+    int _nworkers;
+    alignas(64) std::atomic<int> count{0};
+    alignas(64) std::atomic<int> sense{0};
+    SpinThenBlock waiter;
+    std::vector<padded> local; //sense of each worker
+
+    public:
+    SenseBarrier(int nworkers, int spin) : _nworkers(nworkers), waiter(spin), local(nworkers){}
+
+    void doBarrier(int const& id){
+        int s = local[id].sense = !local[id].sense;
+        if(count.fetch_add(1, std::memory_order_acq_rel) == _nworkers - 1){
+            count.store(0, std::memory_order_relaxed);
+            waiter.release(sense, s);
+        } else {
+            waiter.await(sense, !s);
+        }
+    }
+};
+
+/**
+ * Combining tree barrier: workers arrive in groups of FANIN at the leaves,
+ * the last one of each group goes up to the parent, the last one at the root
+ * flips the global sense. Arrivals contend only within a group, which scales
+ * better than a single counter with many cores.
+ */
+class TreeBarrier : public WorkerBarrier {
+    static constexpr int FANIN = 4;
+
+    struct alignas(64) node {
+        std::atomic<int> count{0};
+        int target = 0;
+        int parent = -1;
+    };
+
+    struct alignas(64) padded {
+        int sense = 0;
+    };
+
+    std::vector<node> nodes;
+    std::vector<padded> local; //sense of each worker
+    alignas(64) std::atomic<int> sense{0};
+    SpinThenBlock waiter;
+
+    public:
+    TreeBarrier(int nworkers, int spin) : local(nworkers), waiter(spin){
+        //nodes of each level are contiguous, level 0 are the leaves
+        int nleaves = (nworkers + FANIN - 1) / FANIN;
+        std::vector<int> targets;
+        for(int i=0; i<nleaves; i++) targets.push_back(std::min(FANIN, nworkers - i*FANIN));
+        std::vector<int> parents;
+        int first = 0, width = nleaves;
+        while(width > 1){
+            int upper = (width + FANIN - 1) / FANIN;
+            for(int i=0; i<width; i++) parents.push_back(first + width + i/FANIN);
+            for(int i=0; i<upper; i++) targets.push_back(std::min(FANIN, width - i*FANIN));
+            first += width;
+            width = upper;
+        }
+        parents.push_back(-1); //root
+        nodes = std::vector<node>(targets.size());
+        for(size_t i=0; i<nodes.size(); i++){
+            nodes[i].target = targets[i];
+            nodes[i].parent = parents[i];
+        }
+    }
+
+    void doBarrier(int const& id){
+        int s = local[id].sense = !local[id].sense;
+        int k = id / FANIN;
+        while(true){
+            node& nd = nodes[k];
+            if(nd.count.fetch_add(1, std::memory_order_acq_rel) != nd.target - 1){
+                waiter.await(sense, !s);
+                return;
+            }
+            nd.count.store(0, std::memory_order_relaxed);
+            if(nd.parent < 0){
+                waiter.release(sense, s);
+                return;
+            }
+            k = nd.parent;
+        }
+    }
+};
+
+/**
+ * Builds the barrier of the given kind: barrier (FastFlow), sense or tree
+ * @param spin iterations spent spinning before blocking
+ * @return nullptr if the kind is unknown
+ */
+inline WorkerBarrier* makeBarrier(std::string const& kind, int const& nworkers, int const& spin){
+    if(kind == "barrier") return new FFWorkerBarrier(nworkers);
+    if(kind == "sense") return new SenseBarrier(nworkers, spin);
+    if(kind == "tree") return new TreeBarrier(nworkers, spin);
+    return nullptr;
+}
+
+/**
+ * Time spent waiting by each worker in each generation
+ */
+class WaitStats {
+    bool _enabled;
+    std::vector<std::vector<long>> usec; //usec[worker][generation]
+    std::vector<long> busy; //usec spent computing by each worker
+
+    public:
+    WaitStats(bool enabled, int nworkers, int nIterations) : _enabled(enabled){
+        if(_enabled) usec = std::vector<std::vector<long>>(nworkers, std::vector<long>(nIterations, 0));
+        if(_enabled) busy = std::vector<long>(nworkers, 0);
+    }
+
+    /**
+     * Accounts time worker w spent computing, to report the share of waits
+     */
+    inline void work(int const& w, long const& t){
+        if(_enabled) busy[w] += t;
+    }
+
+    /**
+     * Runs the wait f of worker w in generation g and accounts its duration
+     */
+    template <class F>
+    inline void timed(int const& w, int const& g, F&& f){
+        if(!_enabled){
+            f();
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        f();
+        usec[w][g] += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+
+    /**
+     * Prints for each worker the total, mean and maximum wait, and the share
+     * of its time spent waiting
+     */
+    void printStats(std::ostream& os){
+        if(!_enabled) return;
+        for(size_t w=0; w<usec.size(); w++){
+            long total = 0, max = 0;
+            size_t gmax = 0;
+            for(size_t g=0; g<usec[w].size(); g++){
+                total += usec[w][g];
+                if(usec[w][g] > max){ max = usec[w][g]; gmax = g; }
+            }
+            os << "worker " << w << ": wait " << total << " usec"
+               << " mean " << (usec[w].empty() ? 0 : total / long(usec[w].size())) << " usec"
+               << " max " << max << " usec at generation " << gmax
+               << " share " << (total + busy[w] > 0 ? 100.0 * total / (total + busy[w]) : 0) << "%"
+               << std::endl;
+        }
+    }
+};
+
+#endif
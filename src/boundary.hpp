@@ -0,0 +1,193 @@
+#ifndef BOUNDARY_HPP
+#define BOUNDARY_HPP
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+/**
+ * Moore neighbourhood (radius 1) of a cell, gathered by the framework
+ * according to the boundary policy and handed to the rule
+ * @tparam T state type
+ */
+template <class T>
+struct Moore {
+    T cells[3][3];
+
+    /**
+     * @param dr row offset in [-1, 1]
+     * @param dc column offset in [-1, 1]
+     * @return the state of the neighbour
+     */
+    inline T const& operator()(int const& dr, int const& dc) const {
+        return cells[dr+1][dc+1];
+    }
+};
+
+/**
+ * Toroidal grid: the last row/column is connected with the first one
+ */
+struct Torus {
+    static constexpr const char* name = "torus";
+
+    /**
+     * @param i row or column index, at most one size outside the grid
+     * @param n size of the grid along the index
+     * @return index in [0, n) read in place of i, -1 if the cell is outside
+     */
+    static inline int source(int const& i, int const& n){
+        return i < 0 ? i + n : (i >= n ? i - n : i);
+    }
+
+    template <class T>
+    static inline T at(const T* grid, int r, int c, int const& n, int const& m){
+        r = r < 0 ? r + n : (r >= n ? r - n : r);
+        c = c < 0 ? c + m : (c >= m ? c - m : c);
+        return grid[long(r)*m + c];
+    }
+};
+
+/**
+ * Every cell outside the grid has the constant state V
+ * @tparam V state of the cells outside the grid
+ */
+template <int V>
+struct Fixed {
+    static constexpr const char* name = "fixed";
+
+    static inline int source(int const& i, int const& n){
+        return i < 0 || i >= n ? -1 : i;
+    }
+
+    template <class T>
+    static inline T at(const T* grid, int r, int c, int const& n, int const& m){
+        if(r < 0 || r >= n || c < 0 || c >= m) return static_cast<T>(V);
+        return grid[long(r)*m + c];
+    }
+};
+
+/**
+ * The grid is mirrored on its edges, the edge itself is not repeated
+ * (row -1 reads row 1, row n reads row n-2)
+ */
+struct Reflective {
+    static constexpr const char* name = "reflective";
+
+    static inline int reflect(int i, int const& n){
+        if(n == 1) return 0;
+        return i < 0 ? -i : (i >= n ? 2*n - 2 - i : i);
+    }
+
+    static inline int source(int const& i, int const& n){
+        return reflect(i, n);
+    }
+
+    template <class T>
+    static inline T at(const T* grid, int r, int c, int const& n, int const& m){
+        return grid[long(reflect(r, n))*m + reflect(c, m)];
+    }
+};
+
+/**
+ * Zero-flux boundary: the cells outside the grid copy the nearest edge cell
+ */
+struct Open {
+    static constexpr const char* name = "open";
+
+    static inline int clamp(int i, int const& n){
+        return i < 0 ? 0 : (i >= n ? n - 1 : i);
+    }
+
+    static inline int source(int const& i, int const& n){
+        return clamp(i, n);
+    }
+
+    template <class T>
+    static inline T at(const T* grid, int r, int c, int const& n, int const& m){
+        return grid[long(clamp(r, n))*m + clamp(c, m)];
+    }
+};
+
+/**
+ * Gathers the neighbourhood of a cell that is not on the grid edges,
+ * no index needs to be adjusted
+ */
+template <class T>
+inline void gatherInterior(const T* grid, long const& k, int const& m, Moore<T>& nb){
+    const T* up = grid + k - m;
+    const T* mid = grid + k;
+    const T* down = grid + k + m;
+    nb.cells[0][0] = up[-1];   nb.cells[0][1] = up[0];   nb.cells[0][2] = up[1];
+    nb.cells[1][0] = mid[-1];  nb.cells[1][1] = mid[0];  nb.cells[1][2] = mid[1];
+    nb.cells[2][0] = down[-1]; nb.cells[2][1] = down[0]; nb.cells[2][2] = down[1];
+}
+
+/**
+ * Gathers the neighbourhood of a cell on the grid edges through the policy B
+ */
+template <class B, class T>
+inline void gatherBoundary(const T* grid, int const& row, int const& col,
+                           int const& n, int const& m, Moore<T>& nb){
+    for(int dr = -1; dr <= 1; dr++)
+        for(int dc = -1; dc <= 1; dc++)
+            nb.cells[dr+1][dc+1] = B::at(grid, row+dr, col+dc, n, m);
+}
+
+/**
+ * Visits the cells with flat index in [start, end) of a n x m grid.
+ * The first/last row and column go through the boundary policy B,
+ * the interior of each row is gathered without any check. The flat
+ * indices are long, a grid can have more than 2^31 cells.
+ * @param grid old state of the matrix 1-d
+ * @param f called as f(k, row, col, nb) for every cell, k long
+ */
+template <class B, class T, class F>
+inline void sweep(const T* grid, int const& n, int const& m,
+                  long const& start, long const& end, F&& f){
+    if(start >= end) return;
+    Moore<T> nb;
+    int lastRow = (end - 1) / m;
+    for(int row = start / m; row <= lastRow; row++){
+        long base = long(row) * m;
+        int from = std::max(start, base) - base;
+        int to = std::min(end, base + m) - base;
+        if(row == 0 || row == n - 1){
+            for(int col = from; col < to; col++){
+                gatherBoundary<B>(grid, row, col, n, m, nb);
+                f(base + col, row, col, nb);
+            }
+            continue;
+        }
+        int col = from;
+        if(col == 0){
+            gatherBoundary<B>(grid, row, 0, n, m, nb);
+            f(base, row, 0, nb);
+            col++;
+        }
+        int inner = std::min(to, m - 1);
+        for(; col < inner; col++){
+            gatherInterior(grid, base + col, m, nb);
+            f(base + col, row, col, nb);
+        }
+        for(; col < to; col++){
+            gatherBoundary<B>(grid, row, col, n, m, nb);
+            f(base + col, row, col, nb);
+        }
+    }
+}
+
+/**
+ * Calls f with an instance of the boundary policy named by the string,
+ * the policy type is then available as decltype of the argument
+ * @return false if the name does not match any policy
+ */
+template <class F>
+inline bool withBoundary(std::string const& name, F&& f){
+    if(name == Torus::name)      { f(Torus{});      return true; }
+    if(name == Fixed<0>::name)   { f(Fixed<0>{});   return true; }
+    if(name == Reflective::name) { f(Reflective{}); return true; }
+    if(name == Open::name)       { f(Open{});       return true; }
+    return false;
+}
+
+#endif
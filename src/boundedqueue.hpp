@@ -0,0 +1,86 @@
+#ifndef BOUNDEDQUEUE_HPP
+#define BOUNDEDQUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/**
+ * Bounded lock-free queue for several producers and consumers (D. Vyukov's
+ * array queue). Each cell has a sequence number telling whether it is free
+ * for the push of a given position or holds the value for its pop, so a
+ * push or pop is one compare-and-swap on the position plus the cell.
+ * @tparam T value type, copied in and out
+ */
+template <class T>
+class BoundedQueue {
+    struct alignas(64) cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    std::unique_ptr<cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0}; //next position to push
+    alignas(64) std::atomic<size_t> tail{0}; //next position to pop
+
+    public:
+    /**
+     * @param capacity values held at most, rounded up to a power of two
+     */
+    BoundedQueue(size_t capacity){
+        size_t size = 1;
+        while(size < capacity) size *= 2;
+        cells.reset(new cell[size]);
+        for(size_t i=0; i<size; i++) cells[i].seq.store(i, std::memory_order_relaxed);
+        mask = size - 1;
+    }
+
+    /**
+     * @return false if the queue is full
+     */
+    bool push(T const& v){
+        size_t pos = head.load(std::memory_order_relaxed);
+        while(true){
+            cell& c = cells[pos & mask];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            long diff = long(seq) - long(pos);
+            if(diff == 0){
+                if(head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    c.value = v;
+                    c.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(diff < 0){
+                return false;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @return false if the queue is empty
+     */
+    bool pop(T& v){
+        size_t pos = tail.load(std::memory_order_relaxed);
+        while(true){
+            cell& c = cells[pos & mask];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            long diff = long(seq) - long(pos + 1);
+            if(diff == 0){
+                if(tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    v = c.value;
+                    c.seq.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(diff < 0){
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+};
+
+#endif
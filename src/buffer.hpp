@@ -0,0 +1,295 @@
+#ifndef BUFFER_HPP
+#define BUFFER_HPP
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <stdexcept>
+#include <iostream>
+#include <vector>
+
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << 26)
+#endif
+
+/**
+ * The two generations of a grid in one allocation, each starting on a page
+ * of the chosen kind so that a range aligned to the page in one generation
+ * is aligned in the other too. The memory is not touched, so the pages are
+ * placed on the nodes of the workers that write them first.
+ *
+ * Pages:
+ * - default: pages of the system, usually 4 KiB
+ * - thp: transparent huge pages, 2 MiB aligned and advised with MADV_HUGEPAGE
+ * - huge: explicit 2 MiB pages from the hugetlb pool (vm.nr_hugepages)
+ * - huge1g: explicit 1 GiB pages, reserved at boot
+ *
+ * A grid file maps the two generations from disk instead, for grids larger
+ * than the memory: a header page, then each generation on its own pages.
+ * The header tells the generation reached and which of the two holds it, so
+ * the file is a checkpoint that the next run continues from. The recorded
+ * half is only read: a new generation is written in the other one, synced,
+ * and only then recorded, see record.
+ */
+template <class T>
+class DoubleBuffer {
+    struct header {
+        char magic[8];
+        uint64_t cells;
+        uint64_t cellSize;
+        uint64_t generation; //generations computed since the file was created
+        uint64_t current;    //generation holding the last state
+    };
+
+    T* gens[2] = {nullptr, nullptr};
+    void* base = nullptr;
+    size_t bytes = 0;
+    bool mapped = false; //munmap instead of free
+    header* file = nullptr; //header of the grid file, if mapped from one
+    int fd = -1;            //grid file, kept open to start the write-back of the stripes
+    char* halves = nullptr; //first generation of the grid file
+    size_t halfBytes = 0;
+
+    static size_t roundUp(size_t x, size_t a){ return (x + a - 1) / a * a; }
+
+    static size_t genBytes(size_t cells, size_t page){
+        return roundUp(std::max<size_t>(1, cells * sizeof(T)), page);
+    }
+
+    static bool readHeader(std::string const& path, size_t cells, header& h){
+        FILE* in = fopen(path.c_str(), "rb");
+        if(in == nullptr) return false;
+        bool ok = fread(&h, sizeof(h), 1, in) == 1;
+        fclose(in);
+        return ok && memcmp(h.magic, "CAGRID1", 8) == 0 && h.cells == cells && h.cellSize == sizeof(T);
+    }
+
+    void mapFile(std::string const& path, size_t cells){
+        header h;
+        if(!readHeader(path, cells, h)) throw std::runtime_error(path + " is not a grid of this size");
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t gen = genBytes(cells, page);
+        bytes = page + 2 * gen;
+        if(h.current > 1) throw std::runtime_error(path + " has a corrupt header");
+        fd = open(path.c_str(), O_RDWR);
+        if(fd < 0) throw std::runtime_error("cannot open " + path);
+        struct stat st;
+        if(fstat(fd, &st) != 0 || size_t(st.st_size) < bytes){ //mapped past the end it would raise SIGBUS
+            close(fd);
+            fd = -1;
+            throw std::runtime_error(path + " is truncated");
+        }
+        base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(base == MAP_FAILED){
+            close(fd);
+            fd = -1;
+            throw std::runtime_error("cannot map " + path);
+        }
+        mapped = true;
+        madvise(base, bytes, MADV_SEQUENTIAL); //the sweeps read the rows in order
+        file = static_cast<header*>(base);
+        halves = static_cast<char*>(base) + page;
+        halfBytes = gen;
+        //the generation reached is always the first one
+        gens[0] = reinterpret_cast<T*>(halves + file->current * gen);
+        gens[1] = reinterpret_cast<T*>(halves + (1 - file->current) * gen);
+    }
+
+    public:
+    static bool valid(std::string const& pages){
+        return pages == "default" || pages == "thp" || pages == "huge" || pages == "huge1g";
+    }
+
+    /**
+     * @return size of the pages of the kind
+     */
+    static size_t pageSize(std::string const& pages){
+        if(pages == "huge1g") return 1UL << 30;
+        if(pages == "thp" || pages == "huge") return 2UL << 20;
+        return sysconf(_SC_PAGESIZE);
+    }
+
+    /**
+     * @param cells cells of one generation
+     * @param pages kind of the pages
+     * @param single both generations in the same memory, for the in-place update
+     * @param path grid file to map, see create, the pages are then those of the page cache
+     */
+    DoubleBuffer(size_t cells, std::string const& pages, bool single = false,
+                 std::string const& path = ""){
+        if(!path.empty()){ //never single, see record
+            mapFile(path, cells);
+            return;
+        }
+        size_t page = pageSize(pages);
+        size_t gen = genBytes(cells, page);
+        bytes = single ? gen : 2 * gen;
+        if(pages == "huge" || pages == "huge1g"){
+            int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (pages == "huge1g" ? MAP_HUGE_1GB : 0);
+            base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+            if(base == MAP_FAILED) throw std::runtime_error(
+                "cannot map " + std::to_string(bytes >> 20) + " MB of " + pages
+                + " pages, see /sys/kernel/mm/hugepages");
+            mapped = true;
+        } else {
+            if(posix_memalign(&base, page, bytes) != 0) throw std::bad_alloc();
+            //only a hint, the kernel may still use small pages
+            if(pages == "thp") madvise(base, bytes, MADV_HUGEPAGE);
+        }
+        gens[0] = static_cast<T*>(base);
+        gens[1] = single ? gens[0] : reinterpret_cast<T*>(static_cast<char*>(base) + gen);
+    }
+
+    /**
+     * Uses two generations allocated by the caller, which are not freed
+     */
+    DoubleBuffer(T* first, T* second){
+        gens[0] = first;
+        gens[1] = second;
+    }
+
+    DoubleBuffer(DoubleBuffer const&) = delete;
+
+    ~DoubleBuffer(){
+        if(mapped) munmap(base, bytes);
+        else free(base);
+        if(fd >= 0) close(fd);
+    }
+
+    inline T* operator[](int const& i) const { return gens[i]; }
+
+    /**
+     * Exchanges the two generations
+     */
+    void swap(){ std::swap(gens[0], gens[1]); }
+
+    /**
+     * @return true if the grid is mapped from a file, its state is then already there
+     */
+    bool fromFile() const { return file != nullptr; }
+
+    /**
+     * Starts writing to the file the cells [start, end) of generation i,
+     * completed by the sweep, so that the dirty pages do not pile up until
+     * record; sync_file_range since msync with MS_ASYNC starts nothing on Linux
+     */
+    void writeBack(int const& i, size_t start, size_t end){
+        if(file == nullptr || start >= end) return;
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t from = (reinterpret_cast<char*>(gens[i] + start) - static_cast<char*>(base)) / page * page;
+        size_t to = reinterpret_cast<char*>(gens[i] + end) - static_cast<char*>(base);
+        sync_file_range(fd, from, to - from, SYNC_FILE_RANGE_WRITE);
+    }
+
+    /**
+     * Records in the file that generation i holds the state the given
+     * generations after the recorded one: i is on disk before the header
+     * points at it, so a crash leaves either the old or the new generation
+     * recorded, whole. Nothing without a grid file.
+     */
+    void record(int const& i, long const& generations){
+        if(file == nullptr) return;
+        char* g = reinterpret_cast<char*>(gens[i]);
+        if(msync(g, halfBytes, MS_SYNC) != 0) throw std::runtime_error("cannot write the grid file");
+        file->generation += generations;
+        file->current = (g - halves) / halfBytes;
+        if(msync(file, sysconf(_SC_PAGESIZE), MS_SYNC) != 0) throw std::runtime_error("cannot write the grid file");
+    }
+
+    /**
+     * @return generations recorded in the grid file since it was created, 0 without one
+     */
+    long generation() const { return file ? file->generation : 0; }
+
+    /**
+     * @return true if path is a grid file with the given cells
+     */
+    static bool isGrid(std::string const& path, size_t cells){
+        header h;
+        return readHeader(path, cells, h);
+    }
+
+    /**
+     * Creates a grid file, the first generation written with the states given
+     * by init for each cell without holding the grid in memory
+     */
+    template <class F>
+    static void create(std::string const& path, size_t cells, F&& init){
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t gen = genBytes(cells, page);
+        FILE* out = fopen(path.c_str(), "wb");
+        if(out == nullptr) throw std::runtime_error("cannot create " + path);
+        std::vector<char> first(page, 0);
+        header h{{'C','A','G','R','I','D','1','\0'}, cells, sizeof(T), 0, 0};
+        memcpy(first.data(), &h, sizeof(h));
+        bool ok = fwrite(first.data(), 1, page, out) == page;
+        std::vector<T> row(std::min<size_t>(cells, 1 << 16));
+        for(size_t k=0; ok && k<cells; k+=row.size()){
+            size_t count = std::min(row.size(), cells - k);
+            for(size_t c=0; c<count; c++) row[c] = init(k + c);
+            ok = fwrite(row.data(), sizeof(T), count, out) == count;
+        }
+        //the rest is left as a hole until the sweeps write it
+        ok = fflush(out) == 0 && ok && ftruncate(fileno(out), page + 2 * gen) == 0;
+        fclose(out);
+        if(!ok) throw std::runtime_error("cannot write " + path);
+    }
+};
+
+/**
+ * Data TLB misses counted with perf for the calling thread and the threads
+ * it creates afterwards, so it must be built before the workers. The counts
+ * of a thread are only added when it exits, so they hold for the backends
+ * whose workers end with the run, not for those kept in a pool
+ */
+class TlbCounter {
+    int fd = -1;
+
+    public:
+    TlbCounter(){
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                    | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.inherit = 1; //the workers are counted too
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    ~TlbCounter(){
+        if(fd >= 0) close(fd);
+    }
+
+    void start(){
+        if(fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    /**
+     * @return misses since start, -1 if perf is not available
+     */
+    long stop(){
+        long count = -1;
+        if(fd < 0) return count;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if(read(fd, &count, sizeof(count)) != sizeof(count)) count = -1;
+        return count;
+    }
+};
+
+#endif
@@ -0,0 +1,228 @@
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <chrono>
+#include <stdexcept>
+#include <getopt.h>
+#include "utimer.cpp"
+#include "ca.hpp"
+#include "life.hpp"
+
+using namespace std;
+using namespace cimg_library;
+
+#ifdef COUNT_ALLOCS
+//counts the allocations of the frame writers after their first frame, see WriteAllocs;
+//every form is replaced, the aligned ones too, so that new and delete always match, and they are
+//not inlined so that the compiler does not pair the malloc of one with the
+//free of the other
+__attribute__((noinline)) void* operator new(size_t n){
+    WriteAllocs::record();
+    if(void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+
+__attribute__((noinline)) void* operator new[](size_t n){ return operator new(n); }
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { operator delete(p); }
+__attribute__((noinline)) void operator delete[](void* p) noexcept { operator delete(p); }
+__attribute__((noinline)) void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+
+//the aligned forms, used for the types aligned to the cache lines
+__attribute__((noinline)) void* operator new(size_t n, align_val_t a){
+    WriteAllocs::record();
+    size_t align = max(size_t(a), sizeof(void*));
+    if(void* p = aligned_alloc(align, (max<size_t>(n, 1) + align - 1) / align * align)) return p;
+    throw bad_alloc();
+}
+
+__attribute__((noinline)) void* operator new[](size_t n, align_val_t a){ return operator new(n, a); }
+__attribute__((noinline)) void operator delete(void* p, align_val_t) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t, align_val_t a) noexcept { operator delete(p, a); }
+__attribute__((noinline)) void operator delete[](void* p, align_val_t a) noexcept { operator delete(p, a); }
+__attribute__((noinline)) void operator delete[](void* p, size_t, align_val_t a) noexcept { operator delete(p, a); }
+#endif
+
+/**
+ * Builds and runs the automaton with the boundary policy B, the time is
+ * measured in the same way for every backend. The initial state is
+ * generated straight into the grid, so that -I holds one grid only; with
+ * -u it is copied by the workers, which place their rows by touching them first
+ * @param throughput print the cells per second and the TLB misses of the run
+ */
+template <class B>
+void runCa(int n, int m, int iter, caConfig const& cfg, LifeRule const& rule, bool throughput){
+    TlbCounter tlb; //inherited by the workers
+    srand(0); //the same initial state for every run of -F and -T
+    vector<int> matrix;
+    if(cfg.numaAware && cfg.gridFile.empty()){
+        matrix.resize(size_t(n)*m);
+        std::generate(matrix.begin(), matrix.end(), random_init);
+    }
+    typedef CellularAutomata<int, unsigned char, B> CA;
+    unique_ptr<Life<CA>> made(matrix.empty()
+        ? new Life<CA>([](size_t){ return random_init(); }, n, m, iter, cfg)
+        : new Life<CA>(matrix, n, m, iter, cfg));
+    Life<CA>& ca = *made;
+    utimer tp("completion time"); //the state is generated before
+    ca.life = rule;
+    ca.init();
+    tlb.start();
+    auto start = chrono::steady_clock::now();
+    ca.run();
+    double usec = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    long misses = tlb.stop();
+    ca.printStats();
+    if(throughput){
+        cout << "throughput " << (usec > 0 ? double(n) * m * iter / usec : 0) << " Mcells/s"
+             << " dTLB misses " << (misses < 0 ? "unavailable" : to_string(misses)) << endl;
+    }
+}
+
+int main(int argc, char* argv[]){
+    string boundary=Torus::name;
+    LifeRule rule;
+    caConfig cfg;
+    bool benchPartition=false;
+    bool benchPages=false;
+    static struct option options[] = {
+        {"backend", required_argument, 0, 'x'},
+        {"boundary", required_argument, 0, 'b'},
+        {"rule", required_argument, 0, 'L'},
+        {"tile", required_argument, 0, 't'},
+        {"chunk", required_argument, 0, 'c'},
+        {"pipeline", required_argument, 0, 'p'},
+        {"frame-depth", required_argument, 0, 'D'},
+        {"writers", required_argument, 0, 'W'},
+        {"png-level", required_argument, 0, 'Z'},
+        {"png-8bit", no_argument, 0, '8'},
+        {"stream", required_argument, 0, 'O'},
+        {"keyframes", required_argument, 0, 'K'},
+        {"numa", no_argument, 0, 'u'},
+        {"sync", required_argument, 0, 's'},
+        {"spin", required_argument, 0, 'S'},
+        {"wait-stats", no_argument, 0, 'w'},
+        {"partition", required_argument, 0, 'P'},
+        {"bench-partition", no_argument, 0, 'F'},
+        {"pages", required_argument, 0, 'H'},
+        {"bench-pages", no_argument, 0, 'T'},
+        {"adaptive", no_argument, 0, 'a'},
+        {"overlap", no_argument, 0, 'o'},
+        {"in-place", no_argument, 0, 'I'},
+        {"grid-file", required_argument, 0, 'M'},
+        {"pass", required_argument, 0, 'G'},
+        {"sparse-density", required_argument, 0, 'R'},
+        {0, 0, 0, 0}
+    };
+    bool usage=false;
+    int opt;
+    while((opt = getopt_long(argc, argv, "x:b:L:t:c:p:D:W:Z:8O:K:us:S:wP:FH:TaoIM:G:R:", options, NULL)) != -1){
+        switch(opt){
+            case 'x': cfg.backend = optarg; break;
+            case 'b': boundary = optarg; break;
+            case 'L': usage = !LifeRule::parse(optarg, rule) || usage; break;
+            case 't': cfg.tileRows = atoi(optarg); break;
+            case 'c': cfg.chunkRows = atoi(optarg); break;
+            case 'p': cfg.frameWorkers = atoi(optarg); break;
+            case 'D': cfg.frameDepth = atoi(optarg); break;
+            case 'W': cfg.frameWriters = atoi(optarg); break;
+            case 'Z': cfg.pngLevel = atoi(optarg); break;
+            case '8': cfg.pngPackBits = false; break;
+            case 'O': cfg.streamFile = optarg; break;
+            case 'K': cfg.keyframes = atoi(optarg); break;
+            case 'u': cfg.numaAware = true; break;
+            case 's': cfg.sync = optarg; break;
+            case 'S': cfg.spin = atoi(optarg); break;
+            case 'w': cfg.waitStats = true; break;
+            case 'P': cfg.partition = optarg; break;
+            case 'F': benchPartition = true; break;
+            case 'H': cfg.pages = optarg; break;
+            case 'T': benchPages = true; break;
+            case 'a': cfg.adaptive = true; break;
+            case 'o': cfg.overlap = true; break;
+            case 'I': cfg.inPlace = true; break;
+            case 'M': cfg.gridFile = optarg; break;
+            case 'G': cfg.passGens = atoi(optarg); break;
+            case 'R': cfg.sparseDensity = atof(optarg); break;
+            default: usage = true;
+        }
+    }
+    if(argc - optind == 4) cfg.nworkers = atoi(argv[optind+3]);
+    string error = usage ? "" : cfg.check();
+    if(error.empty() && !usage && argc - optind >= 3)
+        error = caConfig::checkGrid(atol(argv[optind]), atol(argv[optind+1]), sizeof(int));
+    if(usage || !error.empty() || (argc - optind != 3 && argc - optind != 4)) {
+        if(!error.empty()) cout << error << endl;
+        cout << "Usage is: " << argv[0] << " N M number_step [number_worker]"
+             << " [-x|--backend sequential|thread|parfor|farm|openmp|sparse]"
+             << " [-b torus|fixed|reflective|open] [-L B3/S23] [-t tile_rows] [-c chunk_rows] [-p frame_workers] [-D frame_depth] [-W writers] [-Z png_level] [-8] [-O stream_file] [-K keyframes]"
+             << " [-u] [-s barrier|sense|tree|neighbours] [-S spin] [-w]"
+             << " [-P flat|aligned] [-F] [-H default|thp|huge|huge1g] [-T] [-a] [-o] [-I] [-M grid_file] [-G pass_generations] [-R sparse_density]" << endl
+             << "-M creates the grid file if missing, -M and -G run only on the sequential backend,"
+             << " -G with the fixed, reflective or open boundary, -T with the sequential, thread or farm backend" << endl;
+        return(-1);
+    }
+    int n = atoi(argv[optind]);
+    int m = atoi(argv[optind+1]);
+    int iter = atoi(argv[optind+2]);
+
+    //without a grid file the initial state is generated by each run, see runCa
+    if(!cfg.gridFile.empty() && access(cfg.gridFile.c_str(), F_OK) != 0){
+        //a new grid file, the next runs continue from the state it holds
+        srand(0);
+        try {
+            DoubleBuffer<int>::create(cfg.gridFile, size_t(n)*m, [](size_t){ return random_init(); });
+        } catch(runtime_error const& e) {
+            cout << e.what() << endl;
+            return(-1);
+        }
+    } else if(!cfg.gridFile.empty() && !DoubleBuffer<int>::isGrid(cfg.gridFile, size_t(n)*m)){ //never overwritten
+        cout << cfg.gridFile << " is not a grid of " << n << "x" << m << endl;
+        return(-1);
+    }
+
+    //with -F the run is repeated with both partitionings to show the cost of false sharing
+    vector<string> partitions = benchPartition ? vector<string>{"flat", "aligned"}
+                                               : vector<string>{cfg.partition};
+    //with -T the run is repeated with each kind of pages to show the cost of the TLB misses,
+    //counted only for the workers that exit with the run, see TlbCounter
+    if(benchPages && cfg.backend != "sequential" && cfg.backend != "thread" && cfg.backend != "farm"){
+        cout << "-T counts the TLB misses of the sequential, thread and farm backends,"
+             << " the workers of " << cfg.backend << " outlive the run" << endl;
+        return(-1);
+    }
+    vector<string> pages = benchPages ? vector<string>{"default", "thp", "huge"}
+                                      : vector<string>{cfg.pages};
+    for(auto& p : partitions){
+        for(auto& kind : pages){
+            if(benchPartition) cout << "partition " << p << endl;
+            if(benchPages) cout << "pages " << kind << endl;
+            cfg.partition = p;
+            cfg.pages = kind;
+            error = cfg.check(); //the kind of pages may not suit the other options
+            if(!error.empty()){
+                cout << error << endl;
+                if(!benchPages) return(-1);
+                continue;
+            }
+            try {
+                if(!withBoundary(boundary, [&](auto b){ runCa<decltype(b)>(n, m, iter, cfg, rule, benchPages); })) {
+                    cout << "Unknown boundary " << boundary << endl;
+                    return(-1);
+                }
+            } catch(runtime_error const& e) { //explicit huge pages not reserved
+                cout << e.what() << endl;
+                if(!benchPages) return(-1);
+            }
+        }
+    }
+    #ifdef COUNT_ALLOCS
+    if(WriteAllocs::count > 0){ //see the checkallocs target
+        cout << "the frame writers allocated " << WriteAllocs::count << " times after their first frame" << endl;
+        return(-1);
+    }
+    #endif
+    return 0;
+}
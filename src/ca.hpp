@@ -0,0 +1,1387 @@
+#ifndef CA_HPP
+#define CA_HPP
+
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+#include <ff/barrier.hpp>
+#include <ff/farm.hpp>
+#include <stdlib.h>
+#include <stdio.h>
+#include <iostream>
+#include <functional>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <limits>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#define cimg_use_png
+
+#include "./cimg/CImg.h"
+#include "boundary.hpp"
+#include "stealing.hpp"
+#include "numa.hpp"
+#include "stripesync.hpp"
+#include "barriers.hpp"
+#include "partition.hpp"
+#include "rebalance.hpp"
+#include "buffer.hpp"
+#include "frames.hpp"
+#include "framewriter.hpp"
+#include "stream.hpp"
+#include "inplace.hpp"
+#include "sparse.hpp"
+#include "steppool.hpp"
+#ifdef __cpp_impl_coroutine
+#include "coroutine.hpp"
+#endif
+
+/**
+ * Options of a run, the same for all the backends; check tells which of
+ * them a backend supports
+ */
+struct caConfig {
+    std::string backend = "thread"; //sequential, thread, parfor, farm, openmp or sparse
+    int nworkers = 1;
+    int tileRows = 0;     //thread: rows of a stolen tile, farm: rows of a streamed tile
+    int chunkRows = 0;    //parfor, openmp, sparse: rows of a dynamically scheduled chunk
+    int frameWorkers = 0; //parfor: workers of the render and encode farms
+    int frameDepth = 0;   //frames kept in memory, 0 for twice the workers
+    int frameWriters = 0; //threads writing the frames, 0 for one for each worker
+    int pngLevel = 1;     //zlib level of the frames, 0 stores them uncompressed
+    bool pngPackBits = true; //1-bit png for the black and white frames
+    std::string frameDir = "./frames/"; //directory of the pngs, with the trailing /; empty for no frames on a StepPool
+    std::string streamFile; //frames appended to one file instead of the pngs, see stream.hpp
+    int keyframes = 0;      //stream: generations from a full frame to the next, the others are deltas
+    bool numaAware = false;
+    std::string sync = "barrier"; //barrier, sense, tree or neighbours
+    int spin = 4096;
+    bool waitStats = false;
+    std::string partition = "aligned"; //flat or aligned, see partition.hpp
+    std::string pages = "default"; //default, thp, huge or huge1g, see buffer.hpp
+    bool adaptive = false; //move the range boundaries to balance the measured cost
+    bool overlap = false;  //compute the interior rows before waiting for the neighbours, the waits are reported
+    bool inPlace = false;  //one grid updated row by row, see inplace.hpp
+    std::string gridFile;  //grid mapped from a file instead of the memory, see buffer.hpp
+    int passGens = 1;      //sequential: generations advanced in one sweep of the rows
+    double sparseDensity = 0.05; //sparse: live fraction below which the rows are kept as runs
+
+    /**
+     * @return why the options cannot be used together, empty if they can
+     */
+    std::string check() const {
+        bool owned = backend == "thread" || backend == "parfor" || backend == "farm";
+        if(!owned && backend != "sequential" && backend != "openmp" && backend != "sparse")
+            return "unknown backend " + backend;
+        #ifndef _OPENMP
+        if(backend == "openmp") return "built without OpenMP";
+        #endif
+        if(nworkers < 1 || tileRows < 0 || chunkRows < 0 || frameWorkers < 0 || frameDepth < 0 || frameWriters < 0) return "negative option";
+        if(sync != "barrier" && sync != "sense" && sync != "tree" && sync != "neighbours")
+            return "unknown sync " + sync;
+        if(partition != "flat" && partition != "aligned") return "unknown partition " + partition;
+        if(!DoubleBuffer<char>::valid(pages)) return "unknown pages " + pages;
+        if(passGens < 1) return "a pass advances at least one generation";
+        if(pngLevel < 0 || pngLevel > 9) return "the png level is a zlib level from 0 to 9";
+        if(sparseDensity < 0 || sparseDensity > 1) return "the sparse density is a fraction of the cells";
+        if(!gridFile.empty() && pages != "default") return "a grid file has the pages of the page cache";
+        //the passes write each generation whole in the half the header does not record
+        if(!gridFile.empty() && backend != "sequential") return "only the sequential sweep streams a grid file";
+        if(!gridFile.empty() && inPlace) return "a grid file keeps the recorded generation until the next one is complete";
+        if(passGens > 1 && (backend != "sequential" || inPlace))
+            return "only the sequential sweep advances several generations in a pass";
+        //the ranges and their synchronization belong to the backends with owned stripes
+        if(!owned && (numaAware || sync != "barrier" || waitStats || adaptive || tileRows > 0
+                      || frameWorkers > 0))
+            return backend + " has no owned ranges";
+        if(backend == "sequential" && chunkRows > 0) return "sequential has no chunks";
+        if(tileRows > 0 && backend == "parfor") return "parfor has chunks instead of tiles";
+        if(chunkRows > 0 && (backend == "thread" || backend == "farm")) return backend + " has tiles instead of chunks";
+        if(frameWorkers > 0 && backend != "parfor") return "only parfor has the frame pipeline";
+        //the stripes of the neighbours are fixed
+        if(adaptive && sync == "neighbours") return "the stripes of the neighbours cannot move";
+        //the pages are placed by the first owner of the range, moving it defeats the placement
+        if(adaptive && numaAware) return "the rebalanced stripes leave the pages placed by --numa";
+        //only the neighbours are waited for before computing, the barrier is at the end
+        if(overlap && sync != "neighbours") return "overlap needs the neighbours sync";
+        //the tiles of a stripe can be computed by any worker, so stealing needs the barrier
+        //and the tiles are already balanced
+        if(backend == "thread" && tileRows > 0 && (sync == "neighbours" || adaptive))
+            return "stolen tiles need the barrier";
+        //chunks, streamed tiles and frames handed off have no owner and no barrier
+        bool unowned = chunkRows > 0 || frameWorkers > 0 || (backend == "farm" && tileRows > 0);
+        if(owned && unowned && (adaptive || numaAware || waitStats || sync != "barrier"))
+            return "chunks and streamed tiles have no owner";
+        //the rows of a stripe are overwritten in order by their owner, the whole
+        //generation has to be computed before the saved edges are replaced
+        if(inPlace && ((!owned && backend != "sequential") || unowned || tileRows > 0 || sync == "neighbours"
+                       || adaptive || numaAware))
+            return "in-place needs whole stripes and the barrier";
+        #ifndef WIMG
+        if(frameWorkers > 0) return "the frame pipeline needs the frames";
+        if(!streamFile.empty()) return "the stream needs the frames";
+        #endif
+        if(!streamFile.empty() && frameWorkers > 0) return "the frame pipeline writes pngs";
+        if(keyframes > 0 && streamFile.empty()) return "the delta frames need the stream";
+        return "";
+    }
+
+    /**
+     * @param cellSize bytes of a state
+     * @return why a grid of n x m cells cannot be run, empty if it can: the
+     * flat indices are long and the two generations are addressed in bytes
+     */
+    static std::string checkGrid(long const& n, long const& m, size_t const& cellSize){
+        if(n < 1 || m < 1) return "the grid needs at least one row and one column";
+        if(n > std::numeric_limits<int>::max() || m > std::numeric_limits<int>::max())
+            return "the rows and the columns are ints";
+        if(n > std::numeric_limits<long>::max() / m / 2 / long(cellSize))
+            return "the grid has more cells than can be addressed";
+        return "";
+    }
+};
+
+/**
+ * Parallel strategy running the generations of an automaton, see makeBackend
+ */
+class Backend {
+    public:
+    virtual ~Backend(){}
+
+    virtual void run()=0;
+
+    /**
+     * Prints the counters specific to the strategy
+     */
+    virtual void printStats(std::ostream&){}
+
+    /**
+     * @return done calls completing a frame, one for each owned range
+     */
+    virtual int frameParts(){ return 1; }
+};
+
+/**
+ * Read-only view of the state of an automaton after gen generations, valid
+ * until it is stepped again
+ */
+template <class T>
+struct Snapshot {
+    int gen;
+    int n;
+    int m;
+    const T* cells;
+};
+
+/**
+ * Rule of an automaton and how its states are drawn, the part written by the
+ * user; the automata running it on a grid derive from it, see life.hpp
+ * @tparam T state type
+ * @tparam C CImg type to represent the image
+ */
+template <class T, class C>
+class Automaton {
+    public:
+    typedef T state;
+    typedef C pixel;
+
+    virtual ~Automaton(){}
+
+    /**
+     * Computes the new state of a cell
+     * @param nb old state of the cell and of its neighbours
+     * @return the new state
+     */
+    virtual inline T rule(Moore<T> const& nb)=0;
+
+    /**
+     * Computes the representation of the state and inserts it in the image object
+     * @param img the image object
+     * @param i row index
+     * @param j column index
+     * @param state value of the cell state
+     */
+    virtual inline void repr(cimg_library::CImg<C> &img, int const&i, int const &j, T const& state)=0;
+
+    /**
+     * Used to initialize the image objects
+     * @param n rows
+     * @param m columns
+     * @return the image object
+     */
+    virtual inline cimg_library::CImg<C> imgBuilder(int const& n, int const &m)=0;
+
+    /**
+     * @return name of the rule, saved in the frame streams
+     */
+    virtual std::string ruleName(){ return ""; }
+};
+
+template <class T, class C, class B> class SequentialBackend;
+template <class T, class C, class B> class ThreadBackend;
+template <class T, class C, class B> class ParforBackend;
+template <class T, class C, class B> class FarmBackend;
+template <class T, class C, class B> class OpenMPBackend;
+template <class T, class C, class B> class SparseBackend;
+
+/**
+ * Cellular Automata abstract implementation: the grid, the kernel computing
+ * a range of cells and the generation loop of an owned stripe, shared by all
+ * the backends so that they only differ in how the work is distributed
+ * @tparam T state type
+ * @tparam C CImg type to represent the image
+ * @tparam B boundary policy
+ */
+template <class T, class C, class B = Torus>
+class CellularAutomata : public Automaton<T,C>, public PoolJob {
+    friend class SequentialBackend<T,C,B>;
+    friend class ThreadBackend<T,C,B>;
+    friend class ParforBackend<T,C,B>;
+    friend class FarmBackend<T,C,B>;
+    friend class OpenMPBackend<T,C,B>;
+    friend class SparseBackend<T,C,B>;
+
+    typedef struct {
+        long start; //flat cell indices, a grid can have more than 2^31 cells
+        long end;
+    } range;
+
+    caConfig cfg;
+    int _n; //number of rows
+    int _m; //number of columns
+    DoubleBuffer<T> matrices; //the two matrices as alternating buffers, not touched until a worker writes them
+    const T* _initial; //initial state, copied by the workers
+    int _nIterations;
+    std::vector<range> ranges; //list of ranges to be assigned to each worker
+    WorkerBarrier* ba; //the barrier at the end of each generation
+    WaitStats* waits; //time spent waiting by each worker
+    NumaLayout* numa=nullptr;
+    StripeSync* sync=nullptr; //wait only for the adjacent stripes instead of the barrier
+    Rebalancer* rebalancer=nullptr;
+    RowWindow<T>* window=nullptr; //saved rows of the in-place update
+    std::unique_ptr<Backend> backend;
+    StepPool* pool=nullptr; //pool stepping the generations instead of the backend, see initAsync
+    int _gen=0; //generations reached
+    long _firstGen=0; //generation the grid file was at, the frames are numbered from it
+    int _chunkRows=0; //rows of a chunk stepped on the pool
+    #ifdef WIMG
+    std::unique_ptr<FramePool<C>> frames; //generations being rendered or written
+    std::unique_ptr<FrameStreamWriter> stream; //file of the frames, if not written as pngs
+    static const int MAX_DELTA_CHANNELS = 4; //gray, RGB or RGBA
+    #endif
+
+    using Automaton<T,C>::rule;
+    using Automaton<T,C>::repr;
+    using Automaton<T,C>::imgBuilder;
+    using Automaton<T,C>::ruleName;
+
+    /**
+     * Computes and initializes the ranges that will be assigned to workers
+     */
+    void initRanges(){
+        if(cfg.inPlace) wholeRowPartition(ranges, _n, _m);
+        else partition(cfg.partition, ranges, _n, _m);
+        if(numa){ //whole pages to each worker, unless the grid has too few pages for them
+            std::vector<range> aligned(ranges);
+            for(size_t w=0; w<aligned.size(); w++){
+                aligned[w].start = NumaLayout::alignToPage<T>(ranges[w].start, long(_n)*_m);
+                aligned[w].end   = NumaLayout::alignToPage<T>(ranges[w].end, long(_n)*_m);
+                if(aligned[w].start >= aligned[w].end && ranges[w].start < ranges[w].end) return;
+            }
+            ranges = aligned;
+        }
+    }
+
+    /**
+     * Copies the initial state of [start, end) in both matrices, called by
+     * the worker that owns the range so that its pages are placed on its node,
+     * nothing if the grid is mapped from a file
+     */
+    inline void firstTouch(long const& start, long const& end){
+        if(matrices.fromFile() || _initial == matrices[0]) return; //the state is already in place
+        std::copy(_initial + start, _initial + end, matrices[0] + start);
+        if(!window) std::copy(_initial + start, _initial + end, matrices[1] + start);
+    }
+
+    #ifdef WIMG
+    /**
+     * @return true if the frame of generation j is stored as its XOR with the previous one
+     */
+    inline bool deltaFrame(int const& j) const {
+        return stream && stream->delta(j);
+    }
+
+    /**
+     * Renders the new state of a cell, or in a delta frame the XOR of its
+     * representation with the one of the old state: an unchanged cell is
+     * zero without calling repr. Delta frames expect repr to set the pixel
+     * (col, row) of each channel.
+     */
+    inline void render(cimg_library::CImg<C>& img, bool const& delta, int const& row, int const& col,
+                       T const& old, T const& res){
+        if(!delta){
+            repr(img, row, col, res);
+            return;
+        }
+        if constexpr (std::is_integral<C>::value){
+            int channels = img.spectrum();
+            if(res == old){
+                for(int c=0; c<channels; c++) img(col, row, 0, c) = 0;
+                return;
+            }
+            C before[MAX_DELTA_CHANNELS];
+            repr(img, row, col, old);
+            for(int c=0; c<channels; c++) before[c] = img(col, row, 0, c);
+            repr(img, row, col, res);
+            for(int c=0; c<channels; c++) img(col, row, 0, c) ^= before[c];
+        }
+    }
+    #endif
+
+    /**
+     * Computes the new state of the cells in [start, end) for the iteration j
+     * and renders it, if the automaton has frames
+     * @param index index of the matrix with the old state
+     */
+    inline void compute(bool const& index, [[maybe_unused]] int const& j, long const& start, long const& end){
+        #ifdef WIMG
+        if(frames){
+            auto& img = frames->at(j);
+            bool delta = deltaFrame(j);
+            sweep<B>(matrices[index], _n, _m, start, end,
+                [&](long const& k, int const& row, int const& col, Moore<T> const& nb){
+                auto res=rule(nb);
+                matrices[!index][k]=res;
+                render(img, delta, row, col, matrices[index][k], res);
+            });
+            return;
+        }
+        #endif
+        sweep<B>(matrices[index], _n, _m, start, end,
+            [&](long const& k, int const&, int const&, Moore<T> const& nb){
+            matrices[!index][k]=rule(nb);
+        });
+    }
+
+    /**
+     * Computes the new state of row r for the iteration j from the old state
+     * of the rows it reads, see gatherRows, and renders it
+     * @param rows old state of the rows r-1, r and r+1, null outside the grid
+     * @param out new state of the row
+     */
+    inline void computeRow(const T* const rows[3], [[maybe_unused]] int const& r, [[maybe_unused]] int const& j, T* out){
+        T outside = B::at(matrices[0], -1, -1, _n, _m); //only read by the fixed boundary
+        #ifdef WIMG
+        auto& img = frames->at(j);
+        bool delta = deltaFrame(j);
+        #endif
+        Moore<T> nb;
+        for(int c=0; c<_m; c++){
+            gatherRows<B>(rows, c, _m, outside, nb);
+            out[c] = rule(nb);
+            #ifdef WIMG
+            render(img, delta, r, c, rows[1][c], out[c]);
+            #endif
+        }
+    }
+
+    /**
+     * Computes the new state of the rows of worker i for the iteration j and
+     * writes it in the only grid, see RowWindow
+     */
+    inline void computeInPlace(int const& i, int const& j){
+        T* grid = matrices[0];
+        for(int r=window->firstRow(i); r<window->lastRow(i); r++){
+            const T* rows[3] = {window->old(grid, i, j, r, B::source(r-1, _n)), grid + long(r)*_m,
+                                window->old(grid, i, j, r, B::source(r+1, _n))};
+            computeRow(rows, r, j, window->out(i));
+            window->commit(grid, i, r);
+        }
+    }
+
+    #ifdef WIMG
+    /**
+     * Computes the new state of the cells in [start, end) and copies it in the
+     * snapshot, used by the pipeline instead of rendering in the loop
+     * @param index index of the matrix with the old state
+     */
+    inline void computeInto(bool const& index, long const& start, long const& end, T* snapshot){
+        sweep<B>(matrices[index], _n, _m, start, end,
+            [&](long const& k, int const&, int const&, Moore<T> const& nb){
+            snapshot[k]=matrices[!index][k]=rule(nb);
+        });
+    }
+
+    /**
+     * @return the function writing the frame of generation j, called by the
+     * writers of the pool
+     */
+    std::function<void(int const&, cimg_library::CImg<C>&)> frameSaver(){
+        if(stream){
+            FrameStreamWriter* out = stream.get();
+            return [out](int const& j, cimg_library::CImg<C>& img){
+                thread_local bool first = true;
+                WriteAllocs::Scope counted(first);
+                out->append(j, img);
+            };
+        }
+        PngOptions png{cfg.pngLevel, cfg.pngPackBits};
+        std::string dir = cfg.frameDir;
+        long first = _firstGen;
+        return [png, dir, first](int const& j, cimg_library::CImg<C>& img){
+            thread_local FrameWriter writer(png); //encoder scratch and buffers of the writer
+            thread_local FramePath path(dir.c_str());
+            writer.save(path.of(first + j), img);
+        };
+    }
+    #endif
+
+    /**
+     * Generation loop of the worker owning the range i
+     * @param thid worker running it, for the barrier and the per-worker counters
+     * @param r initial range, moved by the rebalancer
+     */
+    void stripe(int const& i, int const& thid, range r){
+        bool index=0;  //index used to alternate the matrices
+        if(numa) numa->bind(thid);
+        firstTouch(r.start, r.end);
+        if(window) window->saveEdges(matrices[0], i, 0);
+        ba->doBarrier(thid);
+        if(numa) numa->sample(thid, matrices[0], r.start, r.end);
+        long busy=0; //usec spent computing
+        long cells=0; //cells computed in the own range
+        for(int j=0;j<_nIterations;j++){
+            if(sync && !cfg.overlap) waits->timed(thid, j, [&]{ sync->wait(i, j); });
+            auto computeStart = std::chrono::steady_clock::now();
+            if(cfg.overlap){ //the interior rows do not need the neighbours
+                long first, last;
+                StripeSync::interior(r.start, r.end, _m, first, last);
+                compute(index, j, first, last);
+                auto waitStart = std::chrono::steady_clock::now();
+                waits->timed(thid, j, [&]{ sync->wait(i, j); });
+                computeStart += std::chrono::steady_clock::now() - waitStart;
+                compute(index, j, r.start, first);
+                compute(index, j, last, r.end);
+            } else if(window){
+                computeInPlace(i, j);
+                window->saveEdges(matrices[0], i, j+1); //read in the next generation
+            } else {
+                compute(index, j, r.start, r.end);
+            }
+            auto computeEnd = std::chrono::steady_clock::now();
+            #ifdef WIMG
+            frames->done(j);
+            #endif
+            long spent = std::chrono::duration_cast<std::chrono::microseconds>(
+                computeEnd - computeStart).count();
+            busy += spent;
+            waits->work(thid, spent);
+            cells += r.end - r.start;
+            if(rebalancer) rebalancer->record(i, j,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(computeEnd - computeStart).count());
+            if(sync) sync->publish(i, j+1);
+            else waits->timed(thid, j, [&]{ ba->doBarrier(thid); });
+            if(rebalancer) rebalancer->update(i, j, r);
+            index=!index; //switch of the matrix
+        }
+        //read the old state and write the new one
+        if(numa) numa->account(thid, busy, 2L * sizeof(T) * cells);
+    }
+
+    #ifdef WIMG
+    /**
+     * Builds the frame pool and the stream
+     * @param parts done calls completing a frame
+     */
+    void initFrames(int const& parts){
+        //the pipeline renders and writes each snapshot itself, the slots only bound them
+        bool pipeline = cfg.frameWorkers > 0;
+        //the generations of a pass are rendered together
+        int depth = std::max(cfg.passGens, cfg.frameDepth > 0 ? cfg.frameDepth : 2*cfg.nworkers);
+        int writers = pipeline ? 0 : (cfg.frameWriters > 0 ? cfg.frameWriters : cfg.nworkers);
+        auto blank = pipeline ? cimg_library::CImg<C>() : imgBuilder(_n,_m);
+        if(cfg.keyframes > 0 && (!std::is_integral<C>::value || blank.spectrum() > MAX_DELTA_CHANNELS))
+            throw std::runtime_error("delta frames need integer pixels with at most "
+                                     + std::to_string(MAX_DELTA_CHANNELS) + " channels");
+        //the stream takes the compression settings of the pngs
+        if(!cfg.streamFile.empty())
+            stream.reset(new FrameStreamWriter(cfg.streamFile, blank.height(), blank.width(), blank.spectrum(),
+                sizeof(C), _nIterations, _firstGen, ruleName(), cfg.pngLevel, cfg.pngPackBits, cfg.keyframes));
+        frames.reset(new FramePool<C>(depth, parts, writers, blank, frameSaver(), cfg.spin));
+    }
+    #endif
+
+    /**
+     * Builds the ranges, the barrier and the wait counters of both constructors
+     */
+    void setup(){
+        ranges = std::vector<range>(cfg.nworkers);
+        if(cfg.numaAware) numa = new NumaLayout(cfg.nworkers);
+        //with neighbours sync the barrier is only used to start and to write the frames
+        ba = makeBarrier(cfg.sync == "neighbours" ? "barrier" : cfg.sync, cfg.nworkers, cfg.spin);
+        //with overlap the share of the halo waits is part of the timing report
+        waits = new WaitStats(cfg.waitStats || cfg.overlap, cfg.nworkers, _nIterations);
+    }
+
+    public:
+    CellularAutomata(std::vector<T>& initialState, int n, int m, int nIterations, caConfig const& config)
+        : cfg(config), _n(n), _m(m), matrices(size_t(n)*m, config.pages, config.inPlace, config.gridFile),
+          _initial(initialState.data()), _nIterations(nIterations){
+        _firstGen = matrices.generation();
+        setup();
+    }
+
+    /**
+     * Automaton whose initial state is generated straight into its grid, in
+     * the order of the cells, so that no copy of it is kept by the caller;
+     * the grid is then touched first by the calling thread, not by the workers
+     * @param init state of cell i, not called for a grid file that holds a state
+     */
+    CellularAutomata(std::function<T(size_t)> const& init, int n, int m, int nIterations, caConfig const& config)
+        : cfg(config), _n(n), _m(m), matrices(size_t(n)*m, config.pages, config.inPlace, config.gridFile),
+          _nIterations(nIterations){
+        _firstGen = matrices.generation();
+        if(!matrices.fromFile()){
+            for(size_t i=0; i<size_t(n)*m; i++) matrices[0][i] = init(i);
+        }
+        _initial = matrices[0]; //nothing to copy, see firstTouch
+        setup();
+    }
+
+    /**
+     * Automaton on two grids of n*m cells owned by the caller, e.g. kept
+     * across runs, the first one holding the initial state
+     */
+    CellularAutomata(T* first, T* second, int n, int m, int nIterations, caConfig const& config)
+        : cfg(config), _n(n), _m(m), matrices(first, second), _initial(first), _nIterations(nIterations){
+        setup();
+    }
+
+    virtual ~CellularAutomata(){
+        backend.reset();
+        delete numa;
+        delete sync;
+        delete rebalancer;
+        delete window;
+        delete ba;
+        delete waits;
+    }
+
+    /**
+     * Initializes ranges, the backend and the frames
+     */
+    void init(){
+        initRanges();
+        if(cfg.sync == "neighbours") sync = new StripeSync(ranges, _n, _m);
+        if(cfg.adaptive) rebalancer = new Rebalancer(ranges, _n, _m);
+        if(cfg.inPlace) window = new RowWindow<T>(ranges, _n, _m);
+        //a pass computes a row two rows behind the previous generation, which
+        //the boundary only allows if the rows across the edges are adjacent
+        auto far = [](int const& row, int const& edge){ return row >= 0 && std::abs(row - edge) > 1; };
+        if(cfg.passGens > 1 && (far(B::source(-1, _n), 0) || far(B::source(_n, _n), _n-1)))
+            throw std::runtime_error(std::string("the ") + B::name + " boundary advances one generation per pass");
+        backend.reset(makeBackend(cfg.backend, *this));
+        #ifdef WIMG
+        initFrames(backend->frameParts());
+        #endif
+    }
+
+    /**
+     * Main method that runs the computation
+     */
+    void run(){
+        backend->run();
+        _gen = _nIterations;
+        finish();
+    }
+
+    /**
+     * Prepares the automaton to be stepped on the pool instead of run by a
+     * backend. A generation is split in chunks of whole rows starting on a
+     * cache line, as the stripes are; the frames are rendered by the workers
+     * of the pool and written by the writers of the frame pool, only if the
+     * configuration has a frame directory or a stream.
+     */
+    void initAsync(StepPool& p){
+        if(cfg.inPlace || cfg.passGens > 1) throw std::runtime_error("the pool steps one generation of the two grids at a time");
+        pool = &p;
+        int g = lineRows(_m);
+        _chunkRows = std::max(g, PoolJob::CHUNK_CELLS / std::max(1, _m) / g * g);
+        firstTouch(0, long(_n)*_m);
+        #ifdef WIMG
+        if(!cfg.frameDir.empty() || !cfg.streamFile.empty()) initFrames(chunks());
+        #endif
+    }
+
+    int chunks(){
+        return (_n + _chunkRows - 1) / _chunkRows;
+    }
+
+    void computeChunk(int const& c){
+        compute(_gen % 2, _gen, long(c * _chunkRows) * _m, long(std::min(_n, (c+1) * _chunkRows)) * _m);
+        #ifdef WIMG
+        if(frames) frames->done(_gen);
+        #endif
+    }
+
+    void advance(){
+        _gen++;
+    }
+
+    inline Snapshot<T> snapshot() const {
+        return Snapshot<T>{_gen, _n, _m, matrices[_gen % 2]};
+    }
+
+    #ifdef __cpp_impl_coroutine
+    /**
+     * @return awaitable completing after k more generations on the pool; the
+     * awaiting coroutine goes on in the worker that completed the last one,
+     * so no thread waits while the automaton is computed
+     */
+    auto stepAsync(int const& k){
+        if(pool == nullptr) throw std::runtime_error("the automaton is not on a pool, see initAsync");
+        if(k > _nIterations - _gen) throw std::runtime_error("steps past the generations of the run");
+        struct awaiter {
+            StepPool& pool;
+            PoolJob& job;
+            int k;
+            bool await_ready(){ return k <= 0; }
+            void await_suspend(std::coroutine_handle<> h){
+                //the awaiter may be gone once submitted, h is copied
+                pool.submit(&job, k, [h]{ h.resume(); });
+            }
+            void await_resume(){}
+        };
+        return awaiter{*pool, *this, k};
+    }
+
+    /**
+     * @return generator of the snapshots of the next count generations
+     */
+    Generator<Snapshot<T>> generations(int count){
+        for(int i=0; i<count; i++){
+            co_await stepAsync(1);
+            co_yield snapshot();
+        }
+    }
+    #endif
+
+    /**
+     * Waits for the frames to be written; called once, by run or after the
+     * last step on the pool, from a thread that is not a worker of the pool.
+     * A grid file is already up to date, see SequentialBackend::runPasses.
+     */
+    void finish(){
+        #ifdef WIMG
+        if(frames) frames->finish(_gen);
+        if(stream && !stream->close()) std::cout << "Cannot write " << cfg.streamFile << std::endl;
+        #endif
+    }
+
+    /**
+     * Prints the counters of the backend, the wait times, the per-node
+     * bandwidth and the final ranges, if enabled
+     */
+    void printStats(){
+        waits->printStats(std::cout);
+        if(backend) backend->printStats(std::cout);
+        if(numa) numa->printStats(std::cout);
+        if(rebalancer) rebalancer->printStats(std::cout);
+        #ifdef WIMG
+        if(frames) frames->printStats(std::cout);
+        #ifdef COUNT_ALLOCS
+        std::cout << "heap allocations in the steady write loop " << WriteAllocs::count << std::endl;
+        #endif
+        #endif
+    }
+};
+
+/**
+ * One thread computing every generation over the whole grid
+ */
+template <class T, class C, class B>
+class SequentialBackend : public Backend {
+    CellularAutomata<T,C,B>& ca;
+    std::vector<T> lines; //3 rows for each generation inside a pass
+
+    /**
+     * @return row x of the l-th generation of a pass of k: the old grid, the
+     * new one or the lines of the generations in between
+     */
+    inline T* passRow(int const& l, int const& k, int const& x){
+        if(l == 0) return ca.matrices[0] + long(x)*ca._m;
+        if(l == k) return ca.matrices[1] + long(x)*ca._m;
+        return lines.data() + (size_t(l-1)*3 + x%3)*ca._m;
+    }
+
+    /**
+     * Advances up to passGens generations in one sweep of the rows, for a grid
+     * file read from disk once per pass: row r of generation j+l is computed
+     * right after row r+1 of generation j+l-1, so the rows it reads are final.
+     * The generations in between are kept in 3 lines each, only the last one
+     * is written, in the other grid, and its rows are written back to the
+     * file as they are final. The recorded generation is never overwritten:
+     * at the end of the pass the new one is synced, then recorded in the
+     * header, so a run killed at any point leaves a usable checkpoint.
+     */
+    void runPasses(){
+        int n = ca._n, m = ca._m;
+        //rows written back together, about 1 MB
+        int stripeRows = std::max(1, int((1 << 20) / (long(m) * sizeof(T))));
+        lines.resize(size_t(std::max(0, ca.cfg.passGens - 1)) * 3 * m);
+        for(int j=0;j<ca._nIterations;j+=ca.cfg.passGens){
+            int k = std::min(ca.cfg.passGens, ca._nIterations - j);
+            int written = 0; //rows of generation j+k written back
+            for(int t=0; t < n + k-1; t++){
+                for(int l=1; l<=k; l++){
+                    int r = t - (l-1);
+                    if(r < 0 || r >= n) continue;
+                    const T* rows[3];
+                    for(int d=-1; d<=1; d++){
+                        int x = B::source(r+d, n);
+                        rows[d+1] = x < 0 ? nullptr : passRow(l-1, k, x);
+                    }
+                    ca.computeRow(rows, r, j+l-1, passRow(l, k, r));
+                    #ifdef WIMG
+                    if(r == n-1) ca.frames->done(j+l-1);
+                    #endif
+                }
+                int final = t - (k-1) + 1; //rows of generation j+k computed
+                if(final == n || (final > 0 && final - written >= stripeRows)){
+                    ca.matrices.writeBack(1, size_t(written)*m, size_t(final)*m);
+                    written = final;
+                }
+            }
+            ca.matrices.record(1, k);
+            ca.matrices.swap(); //the next pass reads the new generation
+        }
+        //generation g is in matrices[g % 2] at the end, as with the other backends
+        if(ca._nIterations % 2) ca.matrices.swap();
+    }
+
+    public:
+    SequentialBackend(CellularAutomata<T,C,B>& ca) : ca(ca){}
+
+    void run(){
+        ca.firstTouch(0, long(ca._n)*ca._m);
+        if(ca.cfg.passGens > 1 || ca.matrices.fromFile()){
+            runPasses();
+            return;
+        }
+        int nranges = ca.window ? ca.ranges.size() : 0; //the stripes one after the other
+        for(int i=0;i<nranges;i++) ca.window->saveEdges(ca.matrices[0], i, 0);
+        bool index=0; //index used to alternate the matrices
+        for(int j=0;j<ca._nIterations;j++){
+            if(ca.window){
+                for(int i=0;i<nranges;i++) ca.computeInPlace(i, j);
+                for(int i=0;i<nranges;i++) ca.window->saveEdges(ca.matrices[0], i, j+1);
+            } else {
+                ca.compute(index, j, 0, long(ca._n)*ca._m);
+            }
+            #ifdef WIMG
+            ca.frames->done(j);
+            #endif
+            index=!index;
+        }
+    }
+};
+
+/**
+ * One std::thread for each owned range, or tiles stolen from the other
+ * stripes when tileRows is set
+ */
+template <class T, class C, class B>
+class ThreadBackend : public Backend {
+    CellularAutomata<T,C,B>& ca;
+    std::vector<std::thread> _workers;
+    TileScheduler* sched=nullptr;
+
+    /**
+     * Generation loop of worker i with the tiles of the work-stealing scheduler
+     */
+    void tiles(int const& i){
+        bool index=0;
+        auto r = ca.ranges[i];
+        if(ca.numa) ca.numa->bind(i);
+        ca.firstTouch(r.start, r.end);
+        ca.ba->doBarrier(i);
+        if(ca.numa) ca.numa->sample(i, ca.matrices[0], r.start, r.end);
+        long busy=0; //usec spent computing
+        for(int j=0;j<ca._nIterations;j++){
+            auto computeStart = std::chrono::steady_clock::now();
+            sched->reset(i);
+            TileScheduler::tile t;
+            while(sched->next(i, t)) ca.compute(index, j, t.start, t.end);
+            #ifdef WIMG
+            ca.frames->done(j);
+            #endif
+            auto idleStart = std::chrono::steady_clock::now();
+            long spent = std::chrono::duration_cast<std::chrono::microseconds>(
+                idleStart - computeStart).count();
+            busy += spent;
+            ca.waits->work(i, spent);
+            ca.waits->timed(i, j, [&]{ ca.ba->doBarrier(i); });
+            sched->addIdle(i, std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - idleStart).count());
+            index=!index;
+        }
+        //read the old state and write the new one, stolen tiles are not accounted
+        if(ca.numa) ca.numa->account(i, busy, 2L * sizeof(T) * (r.end - r.start) * ca._nIterations);
+    }
+
+    public:
+    ThreadBackend(CellularAutomata<T,C,B>& ca) : ca(ca), _workers(ca.cfg.nworkers){
+        if(ca.cfg.tileRows > 0) sched = new TileScheduler(ca._n, ca._m, ca.cfg.nworkers, ca.cfg.tileRows);
+    }
+
+    ~ThreadBackend(){
+        delete sched;
+    }
+
+    void run(){
+        for(int i=0;i<ca.cfg.nworkers;i++){
+            _workers[i]=std::thread([this](int i){
+                if(sched) tiles(i);
+                else ca.stripe(i, i, ca.ranges[i]);
+            }, i);
+        }
+        for(auto& w : _workers) w.join();
+    }
+
+    void printStats(std::ostream& os){
+        if(sched) sched->printStats(os);
+    }
+
+    int frameParts(){
+        return ca.cfg.nworkers;
+    }
+};
+
+/**
+ * FastFlow ParallelFor: one loop over the owned ranges, or one loop per
+ * generation over chunks of rows, or the frame pipeline
+ */
+template <class T, class C, class B>
+class ParforBackend : public Backend {
+    CellularAutomata<T,C,B>& ca;
+    ff::ParallelFor* pf;
+
+    #ifdef WIMG
+    /**
+     * Generation handed off by the compute stage: the snapshot of the grid,
+     * then its frame, then the encoded png. Generation j uses the task j % depth
+     * of the frame pool, whose slot bounds the generations in flight, and its
+     * buffers are kept for the next generation in the slot
+     */
+    typedef struct {
+        int gen;
+        std::vector<T> cells;
+        cimg_library::CImg<C> img;
+        std::vector<char> png;
+    } frameTask;
+
+    std::vector<frameTask> tasks;
+
+    /**
+     * First stage of the pipeline: computes each generation with the parallel
+     * loop, writing a snapshot together with the new grid, and sends it on
+     */
+    struct computeStage: ff::ff_node_t<frameTask> {
+        ParforBackend<T,C,B>& p;
+
+        computeStage(ParforBackend<T,C,B>& p) : p(p) {}
+
+        frameTask* svc(frameTask*) {
+            auto& ca = p.ca;
+            bool index=0;
+            for(int j=0;j<ca._nIterations;j++){
+                ca.frames->at(j); //no more than depth snapshots in flight
+                frameTask* f = &p.tasks[j % p.tasks.size()];
+                f->gen = j;
+                p.pf->parallel_for_idx(0,ca._n,1,ca.cfg.chunkRows,[&](const long first, const long last, const int) {
+                    ca.computeInto(index, first*ca._m, last*ca._m, f->cells.data());
+                },ca.cfg.nworkers);
+                this->ff_send_out(f);
+                index=!index; //change the index of the matrix
+            }
+            return this->EOS;
+        }
+    };
+
+    /**
+     * Worker of the render farm: builds the frame of a snapshot with repr
+     */
+    struct renderStage: ff::ff_node_t<frameTask> {
+        CellularAutomata<T,C,B>& ca;
+        bool first = true;
+
+        renderStage(CellularAutomata<T,C,B>& ca) : ca(ca) {}
+
+        frameTask* svc(frameTask* f) {
+            WriteAllocs::Scope counted(first); //every pixel is set by repr, the image is reused
+            for(int i=0;i<ca._n;i++){
+                for(int j=0;j<ca._m;j++) ca.repr(f->img, i, j, f->cells[long(i)*ca._m+j]);
+            }
+            return f;
+        }
+    };
+
+    /**
+     * Worker of the encode farm: compresses the frame to a png in memory
+     */
+    struct encodeStage: ff::ff_node_t<frameTask> {
+        FrameWriter writer;
+        bool first = true;
+
+        encodeStage(PngOptions const& png) : writer(png) {}
+
+        frameTask* svc(frameTask* f) {
+            if(FrameWriter::supported(f->img)){
+                WriteAllocs::Scope counted(first);
+                if(writer.encode(f->img)){
+                    auto& png = writer.encoded();
+                    f->png.assign(png.begin(), png.end());
+                    return f;
+                }
+            }
+            //saved by CImg, which allocates: not counted, as in FrameWriter::save
+            char* mem = nullptr;
+            size_t size = 0;
+            FILE* out = open_memstream(&mem, &size);
+            if(out == nullptr) throw std::bad_alloc();
+            f->img.save_png(out);
+            fclose(out);
+            f->png.assign(mem, mem + size);
+            free(mem);
+            return f;
+        }
+    };
+
+    /**
+     * Last stage of the pipeline: writes the encoded frames to disk
+     */
+    struct writeStage: ff::ff_node_t<frameTask> {
+        CellularAutomata<T,C,B>& ca;
+        FramePath paths;
+        bool first = true;
+
+        writeStage(CellularAutomata<T,C,B>& ca) : ca(ca), paths(ca.cfg.frameDir.c_str()) {}
+
+        frameTask* svc(frameTask* f) {
+            WriteAllocs::Scope counted(first);
+            const char* path = paths.of(ca._firstGen + f->gen);
+            int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            bool ok = fd >= 0 && write(fd, f->png.data(), f->png.size()) == ssize_t(f->png.size());
+            if(fd >= 0) ok = close(fd) == 0 && ok;
+            if(!ok) std::cout << "Cannot write " << path << std::endl;
+            ca.frames->release(f->gen); //the task can be reused from here
+            return this->GO_ON;
+        }
+    };
+
+    /**
+     * Runs compute, render, encode and write as the stages of a pipeline, so
+     * the generations keep being computed while the previous ones are
+     * rendered and encoded by their own farms
+     */
+    void runPipeline(){
+        pf->parallel_for_idx(0,ca._n,1,0,[&](const long first, const long last, const int) {
+            ca.firstTouch(first*ca._m, last*ca._m);
+        },ca.cfg.nworkers);
+        auto blank = ca.imgBuilder(ca._n, ca._m);
+        tasks.assign(ca.frames->depth(), frameTask{0, std::vector<T>(size_t(ca._n)*ca._m), blank, {}});
+        for(auto& t : tasks) t.png.reserve(FrameWriter::maxEncoded(blank));
+        computeStage compute(*this);
+        std::vector<std::unique_ptr<ff::ff_node>> R, E;
+        for(int i=0;i<ca.cfg.frameWorkers;i++){
+            R.push_back(std::make_unique<renderStage>(ca));
+            E.push_back(std::make_unique<encodeStage>(PngOptions{ca.cfg.pngLevel, ca.cfg.pngPackBits}));
+        }
+        ff::ff_Farm<frameTask> render(std::move(R));
+        ff::ff_Farm<frameTask> encode(std::move(E));
+        writeStage write(ca);
+        ff::ff_pipeline pipe;
+        pipe.add_stage(&compute);
+        pipe.add_stage(&render);
+        pipe.add_stage(&encode);
+        pipe.add_stage(&write);
+        pipe.run_and_wait_end();
+    }
+    #endif
+
+    /**
+     * Runs the computation with one parallel loop for each generation, the
+     * rows are handed out in chunks of chunkRows by the FastFlow scheduler
+     * as the workers ask for them, the end of the loop is the barrier
+     */
+    void runDynamic(){
+        pf->parallel_for_idx(0,ca._n,1,0,[&](const long first, const long last, const int) {
+            ca.firstTouch(first*ca._m, last*ca._m);
+        },ca.cfg.nworkers);
+        bool index=0;
+        for(int j=0;j<ca._nIterations;j++){
+            pf->parallel_for_idx(0,ca._n,1,ca.cfg.chunkRows,[&](const long first, const long last, const int) {
+                ca.compute(index, j, first*ca._m, last*ca._m);
+            },ca.cfg.nworkers);
+            #ifdef WIMG
+            ca.frames->done(j);
+            #endif
+            index=!index; //change the index of the matrix
+        }
+    }
+
+    public:
+    ParforBackend(CellularAutomata<T,C,B>& ca) : ca(ca){
+        pf = new ff::ParallelFor(ca.cfg.nworkers);
+        //the static ranges are one per worker, the chunks are handed out by the scheduler
+        pf->disableScheduler(ca.cfg.chunkRows == 0);
+    }
+
+    ~ParforBackend(){
+        delete pf;
+    }
+
+    void run(){
+        #ifdef WIMG
+        if(ca.cfg.frameWorkers > 0){
+            runPipeline();
+            return;
+        }
+        #endif
+        if(ca.cfg.chunkRows > 0){
+            runDynamic();
+            return;
+        }
+        pf->parallel_for_thid(0,ca.ranges.size(),1,0,[&](const long i, const int thid) {
+            ca.stripe(i, thid, ca.ranges[i]);
+        },ca.cfg.nworkers);
+    }
+
+    int frameParts(){
+        //the chunks and the pipeline complete a generation with the end of the loop
+        return ca.cfg.chunkRows > 0 || ca.cfg.frameWorkers > 0 ? 1 : int(ca.ranges.size());
+    }
+};
+
+/**
+ * FastFlow farm: one task per owned range, or tiles of rows streamed to the
+ * workers when tileRows is set
+ */
+template <class T, class C, class B>
+class FarmBackend : public Backend {
+    CellularAutomata<T,C,B>& ca;
+
+    struct firstThirdStage: ff::ff_node_t<int> {
+        CellularAutomata<T,C,B>& ca;
+
+        firstThirdStage(CellularAutomata<T,C,B>& ca) : ca(ca) {}
+
+        int* svc(int *task) {
+            if (task == nullptr) {
+                for(int i=0; i<ca.cfg.nworkers; ++i) {
+                    ff_send_out(new int(i));
+                }
+                return GO_ON;
+            }
+            return EOS;
+        }
+    };
+
+    struct secondStage: ff::ff_node_t<int> {
+        CellularAutomata<T,C,B>& ca;
+
+        secondStage(CellularAutomata<T,C,B>& ca) : ca(ca) {}
+
+        int* svc(int * task) {
+            int t = *task;
+            delete task;
+            ca.stripe(t, t, ca.ranges[t]);
+            return EOS;
+        }
+    };
+
+    /**
+     * Tile of rows [start, end) of generation gen, sent by the stream emitter
+     * to a worker and back to the emitter on the feedback channel once computed
+     */
+    typedef struct {
+        int gen;
+        long start;
+        long end;
+    } tileTask;
+
+    /**
+     * Emitter of the streaming farm: sends the tiles of one generation, counts
+     * the completions coming back on the feedback channel and, when they are
+     * all back, hands the frame to the writers and sends the next generation
+     */
+    struct streamEmitter: ff::ff_node_t<tileTask> {
+        CellularAutomata<T,C,B>& ca;
+        std::vector<tileTask> tiles; //reused every generation, a tile is back before it is resent
+        int gen=0;
+        int done=0; //tiles of gen completed
+
+        streamEmitter(CellularAutomata<T,C,B>& ca) : ca(ca) {
+            for(int r=0; r<ca._n; r+=ca.cfg.tileRows){
+                tiles.push_back(tileTask{0, long(r)*ca._m, long(std::min(ca._n, r+ca.cfg.tileRows))*ca._m});
+            }
+        }
+
+        inline void sendGeneration(){
+            for(auto& t : tiles){
+                t.gen = gen;
+                this->ff_send_out(&t);
+            }
+        }
+
+        tileTask* svc(tileTask *task) {
+            if (task == nullptr) {
+                if (ca._nIterations == 0 || tiles.empty()) return this->EOS;
+                sendGeneration();
+                return this->GO_ON;
+            }
+            if (++done < int(tiles.size())) return this->GO_ON;
+            #ifdef WIMG
+            ca.frames->done(gen);
+            #endif
+            done=0;
+            if (++gen == ca._nIterations) return this->EOS;
+            sendGeneration();
+            return this->GO_ON;
+        }
+    };
+
+    /**
+     * Worker of the streaming farm: computes a tile and gives it back
+     */
+    struct streamWorker: ff::ff_node_t<tileTask> {
+        CellularAutomata<T,C,B>& ca;
+
+        streamWorker(CellularAutomata<T,C,B>& ca) : ca(ca) {}
+
+        tileTask* svc(tileTask* t) {
+            ca.compute(t->gen % 2, t->gen, t->start, t->end);
+            return t;
+        }
+    };
+
+    std::vector<std::unique_ptr<ff::ff_node>> W;
+    firstThirdStage* firstThird=nullptr;
+    ff::ff_Farm<int>* farm=nullptr;
+    streamEmitter* emitter=nullptr;
+    ff::ff_Farm<tileTask>* streamFarm=nullptr;
+
+    public:
+    FarmBackend(CellularAutomata<T,C,B>& ca) : ca(ca){
+        if(ca.cfg.tileRows > 0){
+            emitter = new streamEmitter(ca);
+            for(int i=0;i<ca.cfg.nworkers;++i) W.push_back(std::make_unique<streamWorker>(ca));
+            streamFarm = new ff::ff_Farm<tileTask>(std::move(W), *emitter);
+            streamFarm->remove_collector();
+            streamFarm->wrap_around(); //completions go back to the emitter
+            streamFarm->set_scheduling_ondemand(); //a tile to whichever worker is free
+            return;
+        }
+        firstThird = new firstThirdStage(ca);
+        for(int i=0;i<ca.cfg.nworkers;++i) W.push_back(std::make_unique<secondStage>(ca));
+        farm = new ff::ff_Farm<int>(std::move(W), *firstThird);
+        farm->remove_collector(); // needed because the collector is present by default in the ff_Farm
+        farm->wrap_around();   // this call creates feedbacks from Workers to the Emitter
+    }
+
+    ~FarmBackend(){
+        delete farm;
+        delete firstThird;
+        delete streamFarm;
+        delete emitter;
+    }
+
+    void run(){
+        if (streamFarm) {
+            ca.firstTouch(0, long(ca._n)*ca._m); //tiles have no owner
+            streamFarm->run_and_wait_end();
+            return;
+        }
+        farm->run_and_wait_end();
+    }
+
+    int frameParts(){
+        return streamFarm ? 1 : ca.cfg.nworkers;
+    }
+};
+
+/**
+ * OpenMP: one parallel region, a worksharing loop over the rows for each
+ * generation with its implicit barrier; static blocks, or dynamic chunks of
+ * chunkRows rows
+ */
+template <class T, class C, class B>
+class OpenMPBackend : public Backend {
+    CellularAutomata<T,C,B>& ca;
+
+    public:
+    OpenMPBackend(CellularAutomata<T,C,B>& ca) : ca(ca){}
+
+    void run(){
+        #ifdef _OPENMP
+        int n = ca._n, m = ca._m;
+        omp_set_schedule(ca.cfg.chunkRows > 0 ? omp_sched_dynamic : omp_sched_static, ca.cfg.chunkRows);
+        #pragma omp parallel num_threads(ca.cfg.nworkers)
+        {
+            //the same rows as the generations, so the pages are placed where they are computed
+            #pragma omp for schedule(runtime)
+            for(int row=0; row<n; row++) ca.firstTouch(long(row)*m, long(row+1)*m);
+            bool index=0;
+            for(int j=0;j<ca._nIterations;j++){
+                #pragma omp for schedule(runtime)
+                for(int row=0; row<n; row++) ca.compute(index, j, long(row)*m, long(row+1)*m);
+                #ifdef WIMG
+                #pragma omp master
+                ca.frames->done(j);
+                #endif
+                index=!index;
+            }
+        }
+        #endif
+    }
+};
+
+/**
+ * FastFlow ParallelFor over the rows, with the grid kept as runs of live
+ * cells while at most sparseDensity of the cells are alive: each generation
+ * is then computed on the runs, see RunKernel. Denser generations are
+ * computed on the matrices, the grid is converted when the density crosses
+ * the threshold and back to the matrices at the end.
+ */
+template <class T, class C, class B>
+class SparseBackend : public Backend {
+    CellularAutomata<T,C,B>& ca;
+    ff::ParallelFor* pf;
+    SparseGrid<T> gens[2];
+    std::vector<RunKernel<T>> kernels; //one for each worker
+    std::vector<long> live; //live cells of each row in the last generation
+    long sparseGens=0;
+    long conversions=0;
+
+    /**
+     * Calls f(first, last, thid) for the rows in parallel
+     */
+    template <class F>
+    inline void rows(F&& f){
+        pf->parallel_for_idx(0,ca._n,1,ca.cfg.chunkRows,[&](const long first, const long last, const int thid) {
+            f(int(first), int(last), thid);
+        },ca.cfg.nworkers);
+    }
+
+    /**
+     * @param runs whether the grid is kept as runs now, it stays so up to
+     * twice the threshold so that it is not converted back and forth
+     * @return whether the next generation is computed on the runs
+     */
+    inline bool sparse(bool const& runs){
+        long total = 0;
+        for(long l : live) total += l;
+        return total < (runs ? 2 : 1) * ca.cfg.sparseDensity * ca._n * ca._m;
+    }
+
+    public:
+    SparseBackend(CellularAutomata<T,C,B>& ca) : ca(ca), live(ca._n, 0){
+        //the cells far from the live ones are not evaluated
+        Moore<T> dead{};
+        if(ca.rule(dead) != T()) throw std::runtime_error("the rule revives dead cells, the grid cannot be sparse");
+        if(B::source(-1, ca._n) < 0 && B::at(ca.matrices[0], -1, -1, ca._n, ca._m) != T())
+            throw std::runtime_error("the cells outside the grid are alive, the grid cannot be sparse");
+        for(auto& g : gens) g = SparseGrid<T>(ca._n, ca._m);
+        kernels = std::vector<RunKernel<T>>(ca.cfg.nworkers, RunKernel<T>(ca._m));
+        pf = new ff::ParallelFor(ca.cfg.nworkers);
+        pf->disableScheduler(ca.cfg.chunkRows == 0);
+    }
+
+    ~SparseBackend(){
+        delete pf;
+    }
+
+    void run(){
+        int n = ca._n, m = ca._m;
+        rows([&](int first, int last, int){
+            ca.firstTouch(long(first)*m, long(last)*m);
+            for(int r=first; r<last; r++) live[r] = std::count_if(ca.matrices[0] + long(r)*m,
+                ca.matrices[0] + long(r+1)*m, [](T const& s){ return s != T(); });
+        });
+        bool runs = sparse(false);
+        //the dense state of generation j is in matrices[j % 2], as in the other backends
+        if(runs) rows([&](int first, int last, int){ gens[0].fromDense(ca.matrices[0], first, last); });
+        for(int j=0;j<ca._nIterations;j++){
+            bool index = j % 2;
+            if(runs){
+                rows([&](int first, int last, int thid){
+                    #ifdef WIMG
+                    auto& img = ca.frames->at(j);
+                    bool delta = ca.deltaFrame(j);
+                    #endif
+                    for(int r=first; r<last; r++){
+                        auto& out = gens[!index].row(r);
+                        live[r] = kernels[thid].template step<B>(gens[index], r, n, out,
+                            [&](Moore<T> const& nb){ return ca.rule(nb); });
+                        #ifdef WIMG
+                        auto& in = gens[index].row(r);
+                        size_t a = 0, b = 0; //runs of the old and new row reaching column c
+                        for(int c=0; c<m; c++){
+                            while(a < in.size() && in[a].end <= c) a++;
+                            while(b < out.size() && out[b].end <= c) b++;
+                            ca.render(img, delta, r, c, a < in.size() && in[a].start <= c ? in[a].state : T(),
+                                      b < out.size() && out[b].start <= c ? out[b].state : T());
+                        }
+                        #endif
+                    }
+                });
+                sparseGens++;
+            } else {
+                rows([&](int first, int last, int){
+                    ca.compute(index, j, long(first)*m, long(last)*m);
+                    for(int r=first; r<last; r++) live[r] = std::count_if(ca.matrices[!index] + long(r)*m,
+                        ca.matrices[!index] + long(r+1)*m, [](T const& s){ return s != T(); });
+                });
+            }
+            #ifdef WIMG
+            ca.frames->done(j);
+            #endif
+            if(sparse(runs) != runs){
+                runs = !runs;
+                conversions++;
+                if(runs) rows([&](int first, int last, int){ gens[!index].fromDense(ca.matrices[!index], first, last); });
+                else rows([&](int first, int last, int){ gens[!index].toDense(ca.matrices[!index], first, last); });
+            }
+        }
+        int last = ca._nIterations % 2;
+        if(runs) rows([&](int first, int end, int){ gens[last].toDense(ca.matrices[last], first, end); });
+    }
+
+    void printStats(std::ostream& os){
+        os << "sparse generations " << sparseGens << " of " << ca._nIterations
+           << " conversions " << conversions << std::endl;
+    }
+};
+
+/**
+ * @return the backend named kind running the automaton
+ */
+template <class T, class C, class B>
+Backend* makeBackend(std::string const& kind, CellularAutomata<T,C,B>& ca){
+    if(kind == "sequential") return new SequentialBackend<T,C,B>(ca);
+    if(kind == "parfor") return new ParforBackend<T,C,B>(ca);
+    if(kind == "farm") return new FarmBackend<T,C,B>(ca);
+    if(kind == "openmp") return new OpenMPBackend<T,C,B>(ca);
+    if(kind == "sparse") return new SparseBackend<T,C,B>(ca);
+    return new ThreadBackend<T,C,B>(ca);
+}
+
+#endif
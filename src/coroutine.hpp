@@ -0,0 +1,175 @@
+#ifndef COROUTINE_HPP
+#define COROUTINE_HPP
+
+#include <coroutine>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <utility>
+
+/**
+ * Lazily started coroutine: it runs when awaited, and the awaiting
+ * coroutine is resumed in the thread that completes it
+ */
+class Task {
+    public:
+    struct promise_type {
+        std::coroutine_handle<> continuation = std::noop_coroutine();
+        std::exception_ptr error;
+
+        struct final {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                return h.promise().continuation;
+            }
+            void await_resume() noexcept {}
+        };
+
+        Task get_return_object(){
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        final final_suspend() noexcept { return {}; }
+        void return_void(){}
+        void unhandled_exception(){ error = std::current_exception(); }
+    };
+
+    Task(Task&& t) : h(std::exchange(t.h, nullptr)){}
+    Task(Task const&) = delete;
+
+    ~Task(){
+        if(h) h.destroy();
+    }
+
+    auto operator co_await(){
+        struct awaiter {
+            std::coroutine_handle<promise_type> h;
+            bool await_ready(){ return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> c){
+                h.promise().continuation = c;
+                return h;
+            }
+            void await_resume(){
+                if(h.promise().error) std::rethrow_exception(h.promise().error);
+            }
+        };
+        return awaiter{h};
+    }
+
+    private:
+    std::coroutine_handle<promise_type> h;
+
+    explicit Task(std::coroutine_handle<promise_type> h) : h(h){}
+};
+
+/**
+ * Asynchronous generator: the consumer awaits next(), the producer may
+ * itself await between two co_yield and the consumer goes on in the thread
+ * that produced the value. The value is valid until the next call of next().
+ */
+template <class T>
+class Generator {
+    public:
+    struct promise_type {
+        const T* value = nullptr; //nullptr once the producer has returned
+        std::coroutine_handle<> consumer;
+        std::exception_ptr error;
+
+        struct yield {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                return h.promise().consumer;
+            }
+            void await_resume() noexcept {}
+        };
+
+        Generator get_return_object(){
+            return Generator(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        yield yield_value(T const& v) noexcept {
+            value = &v;
+            return {};
+        }
+        yield final_suspend() noexcept {
+            value = nullptr;
+            return {};
+        }
+        void return_void(){}
+        void unhandled_exception(){ error = std::current_exception(); }
+    };
+
+    Generator(Generator&& g) : h(std::exchange(g.h, nullptr)){}
+    Generator(Generator const&) = delete;
+
+    ~Generator(){
+        if(h) h.destroy();
+    }
+
+    /**
+     * @return awaitable of a pointer to the next value, nullptr at the end;
+     * must not be awaited again after the end
+     */
+    auto next(){
+        struct awaiter {
+            std::coroutine_handle<promise_type> h;
+            bool await_ready(){ return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> c){
+                h.promise().consumer = c;
+                return h;
+            }
+            const T* await_resume(){
+                if(h.promise().error) std::rethrow_exception(h.promise().error);
+                return h.promise().value;
+            }
+        };
+        return awaiter{h};
+    }
+
+    private:
+    std::coroutine_handle<promise_type> h;
+
+    explicit Generator(std::coroutine_handle<promise_type> h) : h(h){}
+};
+
+/**
+ * Coroutine started at once and destroyed at its end
+ */
+struct Detached {
+    struct promise_type {
+        Detached get_return_object(){ return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void(){}
+        void unhandled_exception(){ std::terminate(); }
+    };
+};
+
+inline Detached signalWhenDone(Task& t, std::mutex& mtx, std::condition_variable& cv,
+                               bool& done, std::exception_ptr& error){
+    try {
+        co_await t;
+    } catch(...) {
+        error = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    done = true;
+    cv.notify_one();
+}
+
+/**
+ * Blocks the calling thread, which must not belong to the pool the task
+ * runs on, until the task has completed
+ */
+inline void syncWait(Task t){
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool done = false;
+    std::exception_ptr error;
+    signalWhenDone(t, mtx, cv, done, error);
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [&]{ return done; });
+    if(error) std::rethrow_exception(error);
+}
+
+#endif
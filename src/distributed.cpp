@@ -0,0 +1,512 @@
+#include <stdlib.h>
+#include <iostream>
+#include <stdio.h>
+#include <functional>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <sys/wait.h>
+#include <cstdint>
+#include <cassert>
+#include <getopt.h>
+#include "utimer.cpp"
+#include "ca.hpp"
+#include "life.hpp"
+#include "transport.hpp"
+
+using namespace std;
+using namespace cimg_library;
+
+/**
+ * Automaton distributed over processes, with the rule of Automaton and the
+ * sweep kernel of boundary.hpp as the automaton of ca.hpp.
+ * The grid is split in a PR x PC grid of blocks, one for each process; every
+ * process keeps only its block with a one-cell halo, which is exchanged with
+ * the processes owning the adjacent blocks at each generation.
+ * @tparam T state type
+ * @tparam C CImg type to represent the image
+ * @tparam B boundary policy
+ */
+template <class T, class C, class B = Torus>
+class BlockAutomata : public Automaton<T,C> {
+    using Automaton<T,C>::rule;
+    using Automaton<T,C>::repr;
+    using Automaton<T,C>::imgBuilder;
+
+    /**
+     * Row or column of the halo and where it comes from. The owner sends the
+     * line src of its block, the receiver stores it in its halo line dst.
+     */
+    typedef struct {
+        int owner;    //rank of the process owning the source line, -1 for a constant
+        int receiver; //rank of the process whose halo is filled
+        int src;      //local index of the source line in the owner block
+        int dst;      //local index of the halo line in the receiver block
+    } transfer;
+
+    int _n; //number of rows
+    int _m; //number of columns
+    int _nIterations;
+    int _pr; //rows of the process grid
+    int _pc; //columns of the process grid
+    int _rank;
+    int _row; //coordinates of the process in the process grid
+    int _col;
+    vector<int> rowStarts; //first row of each block row, _pr+1
+    vector<int> colStarts; //first column of each block column, _pc+1
+    int _bn; //rows of the block
+    int _bm; //columns of the block
+    int _stride; //row length of the local buffers, with the halo
+    vector<vector<T>> matrices; //the two local blocks with the halo, as alternating buffers
+    vector<transfer> rowHalo; //halo rows of the processes of the same block column
+    vector<transfer> colHalo; //halo columns of the processes of the same block row
+    vector<Message> rowSends[2], rowRecvs[2]; //halo rows of each matrix, in place in the block
+    vector<Message> colSends, colRecvs; //halo columns, packed in colOut and colIn
+    vector<vector<T>> colOut, colIn;
+    vector<int> colOutSrc, colInDst; //column of the block packed in each buffer, or filled from it
+    Transport* net=nullptr;
+    bool _overlap; //compute the interior while the halo is exchanged
+    Background* comm=nullptr; //thread running the exchange with _overlap
+    long computeTime=0; //usec spent computing
+    long haloWait=0; //usec spent waiting for the halo
+    #ifdef WIMG
+    CImg<C> frame; //frame assembled by rank 0
+    vector<vector<T>> blocks; //block of each rank: the own one packed, or the ones received by rank 0
+    vector<Message> frameMsgs; //messages of the gather, built once
+    FrameWriter writer;
+    FramePath paths;
+    #endif
+
+    inline int rankOf(int const& r, int const& c){
+        return r*_pc + c;
+    }
+
+    /**
+     * @return block index along a dimension of the global index i
+     */
+    static inline int owner(vector<int> const& starts, int const& i){
+        return upper_bound(starts.begin(), starts.end(), i) - starts.begin() - 1;
+    }
+
+    /**
+     * Plans the halo lines of every block of the same block column (rows) or
+     * of the same block row (columns), listed in the same order by all the
+     * processes so that the messages between two of them match
+     * @param starts block starts along the dimension
+     * @param size size of the grid along the dimension
+     * @param rankAt rank of the process with the given block index along the dimension
+     */
+    template <class F>
+    vector<transfer> planHalo(vector<int> const& starts, int const& size, F&& rankAt){
+        vector<transfer> res;
+        for(size_t b=0; b+1<starts.size(); b++){
+            int first = starts[b], last = starts[b+1];
+            int halo[2] = {first - 1, last};
+            int dst[2] = {0, last - first + 1};
+            for(int h=0; h<2; h++){
+                int src = halo[h] < 0 || halo[h] >= size ? B::source(halo[h], size) : halo[h];
+                transfer t{-1, rankAt(b), 0, dst[h]};
+                if(src >= 0){
+                    int o = owner(starts, src);
+                    t.owner = rankAt(o);
+                    t.src = src - starts[o] + 1;
+                }
+                res.push_back(t);
+            }
+        }
+        return res;
+    }
+
+    /**
+     * Builds the messages of the exchanges and the buffers of the columns
+     * once, the exchanges of every generation only fill them
+     */
+    void planMessages(){
+        for(int idx=0; idx<2; idx++){
+            T* g = matrices[idx].data();
+            //rows are contiguous in the block, columns [1, _bm]
+            for(auto& t : rowHalo){
+                if(t.owner < 0 || t.owner == t.receiver) continue;
+                if(t.receiver == _rank) rowRecvs[idx].push_back(Message{t.owner, (char*)(g + t.dst*_stride + 1), _bm*sizeof(T)});
+                else if(t.owner == _rank) rowSends[idx].push_back(Message{t.receiver, (char*)(g + t.src*_stride + 1), _bm*sizeof(T)});
+            }
+        }
+        //columns are packed, rows [0, _bn+1]
+        int len = _bn + 2;
+        for(auto& t : colHalo){
+            if(t.owner < 0 || t.owner == t.receiver) continue;
+            if(t.receiver == _rank){
+                colIn.emplace_back(len);
+                colInDst.push_back(t.dst);
+            } else if(t.owner == _rank){
+                colOut.emplace_back(len);
+                colOutSrc.push_back(t.src);
+            }
+        }
+        size_t in = 0, out = 0;
+        for(auto& t : colHalo){
+            if(t.owner < 0 || t.owner == t.receiver) continue;
+            if(t.receiver == _rank) colRecvs.push_back(Message{t.owner, (char*)colIn[in++].data(), len*sizeof(T)});
+            else if(t.owner == _rank) colSends.push_back(Message{t.receiver, (char*)colOut[out++].data(), len*sizeof(T)});
+        }
+    }
+
+    /**
+     * Exchanges the halo rows, then the halo columns including the halo rows,
+     * which also fills the corners
+     * @param index index of the matrix with the old state
+     */
+    void exchange(int const& index){
+        T* g = matrices[index].data();
+        for(auto& t : rowHalo){
+            if(t.receiver != _rank) continue;
+            T* dst = g + t.dst*_stride + 1;
+            if(t.owner < 0){
+                T fill = B::at(g, -1, -1, 1, 1); //only Fixed has constant cells, and ignores the grid
+                std::fill(dst, dst + _bm, fill);
+            } else if(t.owner == _rank){
+                copy(g + t.src*_stride + 1, g + t.src*_stride + 1 + _bm, dst);
+            }
+        }
+        net->exchange(rowSends[index], rowRecvs[index]);
+        int len = _bn + 2;
+        for(auto& t : colHalo){
+            if(t.receiver != _rank) continue;
+            if(t.owner < 0){
+                T fill = B::at(g, -1, -1, 1, 1);
+                for(int i=0; i<len; i++) g[i*_stride + t.dst] = fill;
+            } else if(t.owner == _rank){
+                for(int i=0; i<len; i++) g[i*_stride + t.dst] = g[i*_stride + t.src];
+            }
+        }
+        for(size_t k=0; k<colOut.size(); k++){
+            for(int i=0; i<len; i++) colOut[k][i] = g[i*_stride + colOutSrc[k]];
+        }
+        net->exchange(colSends, colRecvs);
+        for(size_t k=0; k<colIn.size(); k++){
+            for(int i=0; i<len; i++) g[i*_stride + colInDst[k]] = colIn[k][i];
+        }
+    }
+
+    /**
+     * Computes the local rows [r0, r1) and columns [c0, c1) of the block
+     */
+    inline void computeBlock(const T* old, T* next, int r0, int r1, int c0, int c1){
+        //with the halo in place every cell of the block is an interior one of
+        //the buffer, which sweep reads without the boundary policy
+        for(int i=r0; i<r1; i++){
+            sweep<B>(old, _bn+2, _stride, i*_stride + c0, i*_stride + c1,
+                [&](long const& k, int const&, int const&, Moore<T> const& nb){
+                next[k] = rule(nb);
+            });
+        }
+    }
+
+    #ifdef WIMG
+    /**
+     * Sends the block to rank 0, which renders all the blocks in the frame
+     * and saves it
+     */
+    void gather(vector<T>& grid, int const& j){
+        if(_rank != 0){
+            auto& packed = blocks[_rank];
+            for(int i=0; i<_bn; i++) copy(&grid[(i+1)*_stride + 1], &grid[(i+1)*_stride + 1 + _bm], &packed[i*_bm]);
+            net->exchange(frameMsgs, {});
+            return;
+        }
+        int nprocs = _pr*_pc;
+        net->exchange({}, frameMsgs);
+        for(int p=0; p<nprocs; p++){
+            int r = p / _pc, c = p % _pc;
+            int bm = colStarts[c+1] - colStarts[c];
+            for(int i=rowStarts[r]; i<rowStarts[r+1]; i++){
+                for(int k=colStarts[c]; k<colStarts[c+1]; k++){
+                    int li = i - rowStarts[r], lk = k - colStarts[c];
+                    repr(frame, i, k, p == 0 ? grid[(li+1)*_stride + lk+1] : blocks[p][li*bm + lk]);
+                }
+            }
+        }
+        writer.save(paths.of(j), frame);
+    }
+    #endif
+
+    public:
+    /**
+     * @param pr rows of the process grid
+     * @param pc columns of the process grid
+     * @param rank rank of this process
+     */
+    BlockAutomata(int n, int m, int nIterations, int pr, int pc, int rank, bool overlap=false)
+        : _n(n), _m(m), _nIterations(nIterations), _pr(pr), _pc(pc), _rank(rank), _overlap(overlap){
+        _row = _rank / _pc;
+        _col = _rank % _pc;
+        for(int i=0; i<=_pr; i++) rowStarts.push_back(int(long(i) * _n / _pr));
+        for(int i=0; i<=_pc; i++) colStarts.push_back(int(long(i) * _m / _pc));
+        _bn = rowStarts[_row+1] - rowStarts[_row];
+        _bm = colStarts[_col+1] - colStarts[_col];
+        _stride = _bm + 2;
+        matrices = vector<vector<T>>(2, vector<T>((_bn+2) * _stride));
+        rowHalo = planHalo(rowStarts, _n, [&](int b){ return rankOf(b, _col); });
+        colHalo = planHalo(colStarts, _m, [&](int b){ return rankOf(_row, b); });
+        planMessages();
+    }
+
+    ~BlockAutomata(){
+        delete comm;
+        delete net;
+    }
+
+    /**
+     * @return ranks this process exchanges messages with
+     */
+    set<int> peers(){
+        set<int> res;
+        for(auto* plan : {&rowHalo, &colHalo}){
+            for(auto& t : *plan){
+                if(t.owner < 0 || t.owner == t.receiver) continue;
+                if(t.owner == _rank) res.insert(t.receiver);
+                if(t.receiver == _rank) res.insert(t.owner);
+            }
+        }
+        #ifdef WIMG
+        //the frames are gathered by rank 0
+        if(_rank == 0) for(int p=1; p<_pr*_pc; p++) res.insert(p);
+        else res.insert(0);
+        #endif
+        return res;
+    }
+
+    /**
+     * Initializes the block from the global initial state and connects to the peers
+     * @param initial returns the state of the cells in row-major order, one at each call
+     * @param transport channels to the peers, owned by the automaton
+     */
+    template <class F>
+    void init(F&& initial, Transport* transport){
+        net = transport;
+        //the whole sequence is generated, only the own block is kept
+        for(int i=0; i<_n; i++){
+            for(int k=0; k<_m; k++){
+                T s = initial();
+                int li = i - rowStarts[_row], lk = k - colStarts[_col];
+                if(li >= 0 && li < _bn && lk >= 0 && lk < _bm) matrices[0][(li+1)*_stride + lk+1] = s;
+            }
+        }
+        #ifdef WIMG
+        blocks.resize(_pr*_pc);
+        if(_rank == 0){
+            frame = imgBuilder(_n, _m);
+            for(int p=1; p<_pr*_pc; p++){
+                int r = p / _pc, c = p % _pc;
+                blocks[p].resize((rowStarts[r+1]-rowStarts[r]) * (colStarts[c+1]-colStarts[c]));
+                frameMsgs.push_back(Message{p, (char*)blocks[p].data(), blocks[p].size()*sizeof(T)});
+            }
+        } else {
+            blocks[_rank].resize(_bn*_bm);
+            frameMsgs.push_back(Message{0, (char*)blocks[_rank].data(), blocks[_rank].size()*sizeof(T)});
+        }
+        #endif
+        if(_overlap) comm = new Background();
+    }
+
+    /**
+     * Main method that runs the computation
+     */
+    void run(){
+        bool index=0; //index used to alternate the matrices
+        for(int j=0;j<_nIterations;j++){
+            const T* old = matrices[index].data();
+            T* next = matrices[!index].data();
+            auto start = chrono::steady_clock::now();
+            long waited;
+            //the exchange writes only the halo and reads only the edges of the block
+            if(_overlap && _bn > 2 && _bm > 2){
+                comm->start([this, index]{ exchange(index); });
+                computeBlock(old, next, 2, _bn, 2, _bm);
+                auto waitStart = chrono::steady_clock::now();
+                comm->wait();
+                waited = chrono::duration_cast<chrono::microseconds>(
+                    chrono::steady_clock::now() - waitStart).count();
+                computeBlock(old, next, 1, 2, 1, _bm+1);
+                computeBlock(old, next, _bn, _bn+1, 1, _bm+1);
+                computeBlock(old, next, 2, _bn, 1, 2);
+                computeBlock(old, next, 2, _bn, _bm, _bm+1);
+            } else {
+                exchange(index);
+                waited = chrono::duration_cast<chrono::microseconds>(
+                    chrono::steady_clock::now() - start).count();
+                computeBlock(old, next, 1, _bn+1, 1, _bm+1);
+            }
+            haloWait += waited;
+            computeTime += chrono::duration_cast<chrono::microseconds>(
+                chrono::steady_clock::now() - start).count() - waited;
+            #ifdef WIMG
+            gather(matrices[!index], j);
+            #endif
+            index=!index;
+        }
+    }
+
+    /**
+     * Prints the time spent computing and waiting for the halo, and the
+     * share of the waits
+     */
+    void printStats(){
+        ostringstream os; //one write, the processes share the output
+        long total = computeTime + haloWait;
+        os << "rank " << _rank << " block " << _bn << "x" << _bm
+           << ": compute " << computeTime << " usec halo wait " << haloWait << " usec"
+           << " share " << (total > 0 ? 100.0 * haloWait / total : 0) << "%" << endl;
+        cout << os.str() << flush;
+    }
+};
+
+/**
+ * Options of a distributed run
+ */
+typedef struct {
+    string transport; //unix, shm or tcp
+    string key;       //name of the sockets and of the segment of the run
+    vector<string> hosts; //host:port of each rank, for tcp
+    bool overlap;     //compute the interior while the halo is exchanged
+} netOptions;
+
+/**
+ * Builds the transport of the given rank
+ */
+Transport* makeTransport(netOptions const& opts, int rank, int nprocs, set<int> const& peers){
+    if(opts.transport == "unix") return new UnixTransport(rank, peers, opts.key);
+    if(opts.transport == "shm") return new ShmTransport(rank, nprocs, opts.key);
+    return new TcpTransport(rank, peers, opts.hosts);
+}
+
+/**
+ * Builds and runs the block of the given rank with the boundary policy B
+ */
+template <class B>
+void runCa(int n, int m, int iter, int pr, int pc, int rank, netOptions const& opts){
+    unique_ptr<utimer> tp(rank == 0 ? new utimer("completion time") : nullptr);
+    Life<BlockAutomata<int, unsigned char, B>> ca(n, m, iter, pr, pc, rank, opts.overlap);
+    srand(0);
+    ca.init(random_init, makeTransport(opts, rank, pr*pc, ca.peers()));
+    ca.run();
+    ca.printStats();
+}
+
+/**
+ * Runs the given rank
+ * @return exit status of the process
+ */
+int runRank(string const& boundary, int n, int m, int iter, int pr, int pc, int rank,
+            netOptions const& opts){
+    try {
+        if(!withBoundary(boundary, [&](auto b){ runCa<decltype(b)>(n, m, iter, pr, pc, rank, opts); })) {
+            std::cout << "Unknown boundary " << boundary << std::endl;
+            return(-1);
+        }
+    } catch(std::exception const& e) {
+        std::cerr << "rank " << rank << ": " << e.what() << std::endl;
+        return(-1);
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]){
+    string boundary=Torus::name;
+    netOptions opts{"unix", "", {}, false};
+    string hosts;
+    int rank=-1;
+    int port=5000;
+    static struct option options[] = {
+        {"boundary", required_argument, 0, 'b'},
+        {"transport", required_argument, 0, 'x'},
+        {"hosts", required_argument, 0, 'H'},
+        {"port", required_argument, 0, 'p'},
+        {"rank", required_argument, 0, 'r'},
+        {"key", required_argument, 0, 'k'},
+        {"overlap", no_argument, 0, 'o'},
+        {0, 0, 0, 0}
+    };
+    bool usage=false;
+    int opt;
+    while((opt = getopt_long(argc, argv, "b:x:H:p:r:k:o", options, NULL)) != -1){
+        switch(opt){
+            case 'b': boundary = optarg; break;
+            case 'x': opts.transport = optarg; break;
+            case 'H': hosts = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'r': rank = atoi(optarg); break;
+            case 'k': opts.key = optarg; break;
+            case 'o': opts.overlap = true; break;
+            default: usage = true;
+        }
+    }
+
+    if(opts.transport != "unix" && opts.transport != "shm" && opts.transport != "tcp") usage = true;
+    if(usage || argc - optind != 5) {
+        std::cout << "Usage is: " << argv[0] << " N M number_step process_rows process_columns"
+                  << " [-b torus|fixed|reflective|open] [-x unix|shm|tcp]"
+                  << " [-H host:port,...] [-p base_port] [-r rank] [-k key] [-o]" << std::endl
+                  << "Without -r the processes are spawned on this host,"
+                  << " with -r and shm every rank needs the same new -k" << std::endl;
+        return(-1);
+    }
+    int n = atoi(argv[optind]);
+    int m = atoi(argv[optind+1]);
+    int iter = atoi(argv[optind+2]);
+    int pr = atoi(argv[optind+3]);
+    int pc = atoi(argv[optind+4]);
+    int nprocs = pr*pc;
+    if(pr < 1 || pc < 1 || pr > n || pc > m || rank >= nprocs) {
+        std::cout << "Every process needs at least one row and one column" << std::endl;
+        return(-1);
+    }
+    bool launcher = rank < 0;
+    //the ranks started by hand cannot tell a segment of this run from one left
+    //by a crashed run, which would be reused with its rings half full
+    if(!launcher && opts.transport == "shm" && opts.key.empty()) {
+        std::cout << "-r with the shm transport needs a key not used by another run, see -k" << std::endl;
+        return(-1);
+    }
+    if(opts.key.empty()) opts.key = "ca-" + to_string(launcher ? getpid() : 0);
+    if(opts.transport == "tcp"){
+        stringstream ss(hosts);
+        string h;
+        while(getline(ss, h, ',')) opts.hosts.push_back(h);
+        //spawned processes listen on consecutive ports of this host
+        if(opts.hosts.empty()) for(int p=0; p<nprocs; p++) opts.hosts.push_back("127.0.0.1:" + to_string(port + p));
+        if(int(opts.hosts.size()) != nprocs) {
+            std::cout << "Expected " << nprocs << " hosts" << std::endl;
+            return(-1);
+        }
+    }
+    if(!launcher) return runRank(boundary, n, m, iter, pr, pc, rank, opts);
+
+    //launcher: one process for each block on this host
+    if(opts.transport == "shm") shm_unlink(ShmTransport::segment(opts.key).c_str());
+    cout << flush;
+    vector<pid_t> children;
+    for(int r=0; r<nprocs; r++){
+        pid_t pid = fork();
+        if(pid < 0) {
+            perror("fork");
+            return(-1);
+        }
+        if(pid == 0) exit(runRank(boundary, n, m, iter, pr, pc, r, opts));
+        children.push_back(pid);
+    }
+    int res = 0;
+    for(pid_t pid : children){
+        int status;
+        waitpid(pid, &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) res = -1;
+    }
+    if(opts.transport == "shm") shm_unlink(ShmTransport::segment(opts.key).c_str());
+    return res;
+}
@@ -0,0 +1,93 @@
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <getopt.h>
+#define cimg_use_png
+#define cimg_display 0
+
+#include "./cimg/CImg.h"
+#include "stream.hpp"
+
+using namespace std;
+using namespace cimg_library;
+
+/**
+ * Saves the values of a frame of the stream as an image, with the pixel
+ * type of its values
+ */
+template <class C>
+void save(FrameStreamReader const& in, vector<unsigned char> const& values, string const& path){
+    auto& h = in.header();
+    CImg<C> img(reinterpret_cast<const C*>(values.data()), h.cols, h.rows, 1, h.channels);
+    img.save(path.c_str());
+}
+
+/**
+ * Extracts frame k of the stream to a png
+ */
+void extract(FrameStreamReader& in, long const& k, string const& path){
+    vector<unsigned char> values;
+    in.read(k, values);
+    switch(in.header().valueBytes){
+        case 1: save<unsigned char>(in, values, path); break;
+        case 2: save<unsigned short>(in, values, path); break;
+        case 4: save<unsigned int>(in, values, path); break;
+        default: throw runtime_error("values of " + to_string(in.header().valueBytes) + " bytes");
+    }
+}
+
+int main(int argc, char* argv[]){
+    string all;
+    static struct option options[] = {
+        {"all", required_argument, 0, 'a'},
+        {0, 0, 0, 0}
+    };
+    bool usage=false;
+    int opt;
+    while((opt = getopt_long(argc, argv, "a:", options, NULL)) != -1){
+        switch(opt){
+            case 'a': all = optarg; break;
+            default: usage = true;
+        }
+    }
+    int args = argc - optind;
+    if(usage || args < 1 || args > 3 || (!all.empty() && args != 1)) {
+        cout << "Usage is: " << argv[0] << " stream [generation [out.png]] [-a dir]" << endl
+             << "without generation the stream is described, with -a every frame is extracted"
+             << " to dir/<generation>.png" << endl;
+        return(-1);
+    }
+    try {
+        FrameStreamReader in(argv[optind]);
+        auto& h = in.header();
+        long first = h.first; //the frames are read by their position from it
+        if(!all.empty()){
+            for(long k=0; k<in.frames(); k++){
+                if(in.has(k)) extract(in, k, all + "/" + to_string(first + k) + ".png");
+            }
+        } else if(args == 1){
+            long written = 0;
+            for(long k=0; k<in.frames(); k++) written += in.has(k);
+            cout << h.rows << " x " << h.cols << ", " << h.channels << " x " << h.valueBytes
+                 << " bytes per cell, rule " << (h.rule[0] ? h.rule : "unknown") << ", "
+                 << written << " of " << in.frames() << " frames, generations " << first
+                 << " to " << first + in.frames() - 1;
+            if(h.keyframes > 0) cout << ", a keyframe every " << h.keyframes;
+            cout << endl;
+        } else {
+            long g = atol(argv[optind+1]);
+            if(g < first || g >= first + in.frames()){
+                cerr << "generation " << g << " is not in the stream, it has " << first << " to "
+                     << first + in.frames() - 1 << endl;
+                return(-1);
+            }
+            extract(in, g - first, args == 3 ? argv[optind+2] : to_string(g) + ".png");
+        }
+    } catch(runtime_error const& e) {
+        cout << e.what() << endl;
+        return(-1);
+    }
+    return 0;
+}
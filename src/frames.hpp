@@ -0,0 +1,168 @@
+#ifndef FRAMES_HPP
+#define FRAMES_HPP
+
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "./cimg/CImg.h"
+#include "barriers.hpp"
+#include "boundedqueue.hpp"
+
+/**
+ * Bounded pool of frames: generation j is rendered in slot j % depth, which
+ * is handed out again only once the writers have saved the frame it holds,
+ * so at most depth frames are in memory whatever the number of generations.
+ *
+ * A frame is complete after parts calls of done, e.g. one from each worker
+ * owning a stripe. The last one pushes the frame on a lock-free queue and
+ * goes on with the next generation, the writer threads save the complete
+ * frames meanwhile. When they fall behind the workers wait in at for a slot
+ * to be written, which bounds the frames queued as well.
+ *
+ * The pixels of each slot start on a cache line, as the grids do, so the
+ * rows of two workers split on a line boundary never share one, see
+ * rowPartition.
+ * @tparam C CImg type of the frames
+ */
+template <class C>
+class FramePool {
+    static constexpr int FREE = -1;
+
+    int _depth;
+    int _parts;
+    std::vector<cimg_library::CImg<C>> slots; //shared images on the buffers
+    std::vector<C*> buffers; //64-byte aligned pixels of the slots
+    std::vector<std::atomic<int>> owner; //generation in each slot, FREE if none
+    std::vector<std::atomic<int>> pending; //done calls still missing for the frame in each slot
+    std::function<void(int const&, cimg_library::CImg<C>&)> save;
+    std::mutex mtx;
+    std::condition_variable freed; //a slot has been written
+    BoundedQueue<int> complete; //frames to write, at most one for each slot
+    std::atomic<int> queued{0}; //frames pushed, the writers sleep on it
+    SpinThenBlock idle;
+    std::atomic<bool> stop{false};
+    int written = 0;
+    int nwriters;
+    std::vector<std::thread> writers;
+    long stalls = 0; //at calls that waited for a free slot
+
+    void write(){
+        while(true){
+            int seen = queued.load();
+            int j;
+            if(complete.pop(j)){
+                try {
+                    save(j, slots[j % _depth]);
+                } catch(cimg_library::CImgException const&) { //already reported by CImg
+                }
+                release(j);
+                continue;
+            }
+            if(stop.load()) return;
+            idle.await(queued, seen);
+        }
+    }
+
+    public:
+    /**
+     * @param depth frames kept in memory
+     * @param parts done calls completing a frame
+     * @param nwriters threads saving the frames, 0 if they are released by the caller
+     * @param blank image the slots are built from
+     * @param save called by the writers with the generation and its frame
+     * @param spin iterations an idle writer spins before sleeping
+     */
+    FramePool(int depth, int parts, int nwriters, cimg_library::CImg<C> const& blank,
+              std::function<void(int const&, cimg_library::CImg<C>&)> save, int spin = 4096)
+        : _depth(std::max(1, depth)), _parts(parts),
+          slots(_depth), buffers(_depth, nullptr), owner(_depth), pending(_depth), save(save), complete(_depth), idle(spin), nwriters(nwriters){
+        for(auto& o : owner) o.store(FREE);
+        if(!blank.is_empty()){
+            size_t bytes = (blank.size() * sizeof(C) + 63) / 64 * 64;
+            for(int s=0; s<_depth; s++){
+                buffers[s] = static_cast<C*>(aligned_alloc(64, bytes));
+                if(buffers[s] == nullptr) throw std::bad_alloc();
+                std::copy(blank.data(), blank.data() + blank.size(), buffers[s]);
+                slots[s].assign(buffers[s], blank.width(), blank.height(), blank.depth(), blank.spectrum(), true);
+            }
+        }
+        for(int i=0; i<nwriters; i++) writers.emplace_back([this]{ write(); });
+    }
+
+    ~FramePool(){
+        shutdown();
+        for(auto b : buffers) free(b);
+    }
+
+    /**
+     * @return the frame of generation j, waiting for its slot to be written
+     * if it still holds an older one
+     */
+    cimg_library::CImg<C>& at(int const& j){
+        int s = j % _depth;
+        if(owner[s].load(std::memory_order_acquire) == j) return slots[s];
+        std::unique_lock<std::mutex> lock(mtx);
+        if(owner[s] != j && owner[s] != FREE) stalls++;
+        freed.wait(lock, [&]{ return owner[s] == j || owner[s] == FREE; });
+        if(owner[s] == FREE){
+            pending[s].store(_parts, std::memory_order_relaxed);
+            owner[s].store(j, std::memory_order_release);
+        }
+        return slots[s];
+    }
+
+    /**
+     * Marks one part of the frame of generation j as rendered
+     */
+    void done(int const& j){
+        at(j); //a part may have nothing to render
+        if(pending[j % _depth].fetch_sub(1, std::memory_order_acq_rel) > 1) return;
+        complete.push(j); //never full, the frame holds a slot
+        idle.bump(queued);
+    }
+
+    /**
+     * Frees the slot of generation j, for the callers writing the frames themselves
+     */
+    void release(int const& j){
+        std::lock_guard<std::mutex> lock(mtx);
+        owner[j % _depth].store(FREE, std::memory_order_relaxed);
+        written++;
+        freed.notify_all();
+    }
+
+    /**
+     * Stops the writers once the complete frames are written
+     */
+    void shutdown(){
+        stop.store(true);
+        idle.bump(queued);
+        for(auto& w : writers) w.join();
+        writers.clear();
+    }
+
+    /**
+     * Waits for the first nframes frames to be written and stops the writers
+     */
+    void finish(int const& nframes){
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            freed.wait(lock, [&]{ return written >= nframes; });
+        }
+        shutdown();
+    }
+
+    int depth() const { return _depth; }
+
+    void printStats(std::ostream& os){
+        os << "frames: depth " << _depth << " writers " << nwriters << " stalls " << stalls << std::endl;
+    }
+};
+
+#endif
@@ -0,0 +1,316 @@
+#ifndef FRAMEWRITER_HPP
+#define FRAMEWRITER_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <png.h>
+#include <zlib.h>
+#include <csetjmp>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <algorithm>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+#include "./cimg/CImg.h"
+
+/**
+ * Heap allocations made by the threads while they write a frame after their
+ * first one. The arenas and zlib count theirs, operator new is counted when
+ * it is replaced by a COUNT_ALLOCS build, see ca.cpp.
+ */
+struct WriteAllocs {
+    inline static thread_local bool writing = false; //in a write after the first one
+    inline static std::atomic<long> count{0};
+
+    static inline void record(){
+        if(writing) count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * Work of a writer on one frame in the calling thread, counted from the
+     * second frame of the writer on; scopes may be nested
+     */
+    class Scope {
+        bool outer; //writing when the scope was entered
+        bool& _first;
+
+        public:
+        /**
+         * @param first true before the first frame of the writer, then cleared
+         */
+        Scope(bool& first) : outer(writing), _first(first){ writing = !first; }
+
+        ~Scope(){
+            writing = outer;
+            _first = false;
+        }
+    };
+};
+
+/**
+ * Bump allocator reset after each frame. When a frame needs more than the
+ * arena holds, a new chunk is taken from the heap; at the next reset the
+ * chunks are merged into one as large as the peak, so after the first
+ * frames no allocation reaches the heap.
+ */
+class Arena {
+    static const size_t MAX_CHUNKS = 48; //each chunk at least doubles the capacity
+    char* chunks[MAX_CHUNKS];
+    size_t sizes[MAX_CHUNKS];
+    int nchunks = 0;
+    size_t used = 0; //bytes used in the last chunk
+    size_t total = 0; //bytes handed out since the reset
+    size_t capacity = 0;
+
+    void grow(size_t const& n){
+        WriteAllocs::record();
+        size_t size = std::max(n, 2 * capacity);
+        chunks[nchunks] = static_cast<char*>(malloc(size));
+        if(chunks[nchunks] == nullptr) throw std::bad_alloc();
+        sizes[nchunks++] = size;
+        capacity += size;
+        used = 0;
+    }
+
+    void release(){
+        for(int i=0; i<nchunks; i++) free(chunks[i]);
+        nchunks = 0;
+        capacity = 0;
+    }
+
+    public:
+    Arena(size_t initial = 1 << 20){
+        grow(initial);
+    }
+
+    Arena(Arena const&) = delete;
+
+    ~Arena(){
+        release();
+    }
+
+    void* alloc(size_t n){
+        n = (n + 15) / 16 * 16;
+        if(used + n > sizes[nchunks-1]){
+            if(nchunks == int(MAX_CHUNKS)) return nullptr;
+            grow(n);
+        }
+        void* p = chunks[nchunks-1] + used;
+        used += n;
+        total += n;
+        return p;
+    }
+
+    /**
+     * Frees everything allocated since the last reset
+     */
+    void reset(){
+        if(nchunks > 1){
+            size_t peak = total;
+            release();
+            grow(peak);
+        }
+        used = 0;
+        total = 0;
+    }
+};
+
+/**
+ * Path of the frames, the prefix is formatted once and only the number and
+ * the extension are written for each frame
+ */
+class FramePath {
+    char buf[4096];
+    size_t prefix;
+
+    public:
+    FramePath(const char* dir = "./frames/"){
+        prefix = std::min(strlen(dir), sizeof(buf) - 32);
+        memcpy(buf, dir, prefix);
+    }
+
+    /**
+     * @return the path of frame j, valid until the next call
+     */
+    const char* of(long j){
+        char digits[24];
+        int len = 0;
+        do { digits[len++] = '0' + j % 10; j /= 10; } while(j > 0);
+        char* p = buf + prefix;
+        while(len > 0) *p++ = digits[--len];
+        memcpy(p, ".png", 5);
+        return buf;
+    }
+};
+
+/**
+ * Settings of the png files
+ */
+struct PngOptions {
+    int level = 1;        //zlib level, 0 stores the rows uncompressed
+    bool packBits = true; //1-bit gray for the black and white frames
+};
+
+/**
+ * Writes the frames as png files with libpng, one for each thread: the
+ * encoder state comes from the arena, the rows are read from the image in
+ * place and the file is written from a reused buffer, so a frame of the same
+ * size as the previous ones does not allocate. Images other than 8-bit gray
+ * or RGB are saved by CImg.
+ *
+ * The frames of binary automata, only black and white pixels, are written
+ * with 1 bit per pixel. The filter of the rows is fixed instead of chosen
+ * for each row: none for 1 bit, where the filters do not help, up for 8
+ * bits. With the fast zlib levels the filters are most of the encoding time.
+ */
+class FrameWriter {
+    Arena arena;
+    PngOptions opts;
+    std::vector<png_byte> row;  //interleaved RGB or packed row
+    std::vector<char> out;      //encoded file
+    bool first = true;
+    std::jmp_buf jump;
+
+    static png_voidp pngAlloc(png_structp png, png_alloc_size_t n){
+        return static_cast<FrameWriter*>(png_get_mem_ptr(png))->arena.alloc(n);
+    }
+
+    static void pngFree(png_structp, png_voidp){} //freed by the reset
+
+    static void pngWrite(png_structp png, png_bytep data, png_size_t n){
+        auto& out = static_cast<FrameWriter*>(png_get_io_ptr(png))->out;
+        out.insert(out.end(), reinterpret_cast<char*>(data), reinterpret_cast<char*>(data) + n);
+    }
+
+    static void pngFlush(png_structp){}
+
+    static void pngError(png_structp png, png_const_charp){
+        std::longjmp(static_cast<FrameWriter*>(png_get_error_ptr(png))->jump, 1);
+    }
+
+    static void pngWarning(png_structp, png_const_charp){}
+
+    /**
+     * @return true if the pixels are all black or white
+     */
+    static bool blackAndWhite(const unsigned char* data, size_t const& size){
+        unsigned char other = 0; //set by any pixel other than 0 and 255, no branch in the loop
+        for(size_t i=0; i<size; i++) other |= data[i] != 0 && data[i] != 255;
+        return !other;
+    }
+
+    /**
+     * Encodes the 8-bit image in out
+     * @param bits 8, or 1 for a black and white gray image
+     * @return false if libpng failed
+     */
+    bool encodeRows(const unsigned char* data, int const& width, int const& height, int const& channels,
+                    int const& bits){
+        png_structp png = png_create_write_struct_2(PNG_LIBPNG_VER_STRING, this, pngError, pngWarning,
+                                                    this, pngAlloc, pngFree);
+        if(png == nullptr) return false;
+        png_infop info = png_create_info_struct(png);
+        if(info == nullptr || setjmp(jump)){
+            png_destroy_write_struct(&png, &info);
+            return false;
+        }
+        png_set_write_fn(png, this, pngWrite, pngFlush);
+        png_set_compression_level(png, opts.level);
+        png_set_filter(png, PNG_FILTER_TYPE_BASE, bits == 1 ? PNG_FILTER_NONE : PNG_FILTER_UP);
+        png_set_IHDR(png, info, width, height, bits, channels == 1 ? PNG_COLOR_TYPE_GRAY : PNG_COLOR_TYPE_RGB,
+                     PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+        png_write_info(png, info);
+        size_t plane = size_t(width) * height;
+        for(int i=0; i<height; i++){
+            const unsigned char* src = data + size_t(i) * width;
+            if(bits == 1){ //8 pixels in a byte, the first one in the high bit
+                std::fill(row.begin(), row.begin() + (width + 7) / 8, 0);
+                for(int k=0; k<width; k++) row[k >> 3] |= (src[k] != 0) << (7 - (k & 7));
+                png_write_row(png, row.data());
+                continue;
+            }
+            if(channels == 1){
+                png_write_row(png, const_cast<png_bytep>(src));
+                continue;
+            }
+            for(int k=0; k<width; k++){ //CImg keeps the channels in planes
+                for(int c=0; c<3; c++) row[3*k + c] = src[c*plane + k];
+            }
+            png_write_row(png, row.data());
+        }
+        png_write_end(png, info);
+        png_destroy_write_struct(&png, &info);
+        return true;
+    }
+
+    public:
+    FrameWriter(PngOptions const& opts = PngOptions()) : opts(opts){}
+
+    /**
+     * @return true if the image is encoded here, 8-bit gray or RGB
+     */
+    template <class C>
+    static bool supported(cimg_library::CImg<C> const& img){
+        return std::is_same<C, unsigned char>::value && (img.spectrum() == 1 || img.spectrum() == 3);
+    }
+
+    /**
+     * @return bytes of the png of an 8-bit image at most: the rows with their
+     * filter byte deflated in the worst case, split by libpng in chunks of
+     * 8 KB, and the other chunks
+     */
+    template <class C>
+    static size_t maxEncoded(cimg_library::CImg<C> const& img){
+        size_t deflated = compressBound(img.size() + img.height());
+        return deflated + (deflated / 8192 + 1) * 12 + 1024;
+    }
+
+    /**
+     * Encodes a supported image, see encoded
+     * @return false if libpng failed
+     */
+    template <class C>
+    bool encode(cimg_library::CImg<C> const& img){
+        if constexpr (!std::is_same<C, unsigned char>::value){
+            return false;
+        } else {
+            row.resize(3 * size_t(img.width()));
+            out.clear();
+            out.reserve(maxEncoded(img)); //a larger frame later does not grow it
+            bool packed = opts.packBits && img.spectrum() == 1 && blackAndWhite(img.data(), img.size());
+            bool ok = encodeRows(img.data(), img.width(), img.height(), img.spectrum(), packed ? 1 : 8);
+            arena.reset();
+            return ok;
+        }
+    }
+
+    /**
+     * @return the png file of the last image encoded, valid until the next one
+     */
+    std::vector<char> const& encoded() const { return out; }
+
+    /**
+     * Saves the image at path
+     * @return false if it could not be written
+     */
+    template <class C>
+    bool save(const char* path, cimg_library::CImg<C> const& img){
+        if(!supported(img)){
+            img.save(path);
+            return true;
+        }
+        WriteAllocs::Scope counted(first);
+        bool ok = encode(img);
+        if(ok){
+            int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            ok = fd >= 0 && write(fd, out.data(), out.size()) == ssize_t(out.size());
+            if(fd >= 0) ok = close(fd) == 0 && ok;
+        }
+        if(!ok) std::cout << "Cannot write " << path << std::endl;
+        return ok;
+    }
+};
+
+#endif
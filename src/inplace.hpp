@@ -0,0 +1,118 @@
+#ifndef INPLACE_HPP
+#define INPLACE_HPP
+
+#include <algorithm>
+#include <vector>
+#include "boundary.hpp"
+
+/**
+ * Rows saved to update a single grid in place, for rules reading only the
+ * adjacent rows. Each worker owns whole rows and computes them top down into
+ * a line buffer; a row is written back once computed, and its old state is
+ * kept as the row above the next one. The first and last row of each stripe
+ * are saved before the generation, so the neighbours and the wrapped or
+ * reflected edges still read the old state after the owner has written
+ * them. The edges are kept for two generations: a worker saves the next
+ * ones while its neighbours may still read the current ones, the barrier at
+ * the end of the generation is enough.
+ *
+ * Memory: 6 rows per worker instead of a second grid.
+ * @tparam T state type
+ */
+template <class T>
+class RowWindow {
+    struct lines {
+        std::vector<T> edges[2][2]; //first and last row of the stripe for each parity of the generation
+        std::vector<T> buf[2];
+        T* prev; //old state of the row above the one being computed
+        T* out;  //new state of the row being computed
+    };
+
+    int _n;
+    int _m;
+    std::vector<int> first; //first row of each worker
+    std::vector<int> last;  //end of the rows of each worker
+    std::vector<int> owner; //worker of each row
+    std::vector<lines> workers;
+
+    public:
+    /**
+     * @param ranges ranges [start, end) of whole rows owned by each worker
+     */
+    template <class R>
+    RowWindow(std::vector<R> const& ranges, int const& n, int const& m)
+        : _n(n), _m(m), first(ranges.size()), last(ranges.size()), owner(n), workers(ranges.size()){
+        for(size_t i=0; i<ranges.size(); i++){
+            first[i] = ranges[i].start / m;
+            last[i] = ranges[i].end / m;
+            for(int r=first[i]; r<last[i]; r++) owner[r] = i;
+            if(first[i] == last[i]) continue;
+            auto& w = workers[i];
+            for(auto& gen : w.edges) for(auto& e : gen) e.resize(m);
+            for(auto& b : w.buf) b.resize(m);
+            w.prev = w.buf[0].data();
+            w.out = w.buf[1].data();
+        }
+    }
+
+    inline int firstRow(int const& i) const { return first[i]; }
+    inline int lastRow(int const& i) const { return last[i]; }
+    inline T* out(int const& i){ return workers[i].out; }
+
+    /**
+     * Saves the first and last row of worker i, read in generation gen
+     */
+    inline void saveEdges(const T* grid, int const& i, int const& gen){
+        if(first[i] == last[i]) return;
+        auto& e = workers[i].edges[gen % 2];
+        std::copy(grid + long(first[i])*_m, grid + long(first[i]+1)*_m, e[0].begin());
+        std::copy(grid + long(last[i]-1)*_m, grid + long(last[i])*_m, e[1].begin());
+    }
+
+    /**
+     * @param r row computed by worker i
+     * @param x row read, as given by the boundary policy
+     * @return the old state of row x in generation gen, nullptr if it is outside the grid
+     */
+    inline const T* old(const T* grid, int const& i, int const& gen, int const& r, int const& x) const {
+        if(x < 0) return nullptr;
+        if(x >= r && x < last[i]) return grid + long(x)*_m; //not written yet
+        if(x == r-1 && x >= first[i]) return workers[i].prev;
+        int w = owner[x];
+        return workers[w].edges[gen % 2][x == first[w] ? 0 : 1].data();
+    }
+
+    /**
+     * Writes the computed row r of worker i in the grid and keeps its old state
+     */
+    inline void commit(T* grid, int const& i, int const& r){
+        auto& w = workers[i];
+        std::swap_ranges(w.out, w.out + _m, grid + long(r)*_m);
+        std::swap(w.prev, w.out);
+    }
+};
+
+/**
+ * Gathers the neighbourhood of column col from the old state of the rows
+ * above, of the row itself and below, a null row is outside the grid
+ * @param outside state of the cells outside the grid
+ */
+template <class B, class T>
+inline void gatherRows(const T* const rows[3], int const& col, int const& m, T const& outside, Moore<T>& nb){
+    if(col > 0 && col < m-1 && rows[0] && rows[2]){
+        for(int dr=0; dr<3; dr++){
+            nb.cells[dr][0] = rows[dr][col-1];
+            nb.cells[dr][1] = rows[dr][col];
+            nb.cells[dr][2] = rows[dr][col+1];
+        }
+        return;
+    }
+    for(int dr=0; dr<3; dr++){
+        for(int dc=-1; dc<=1; dc++){
+            int c = B::source(col+dc, m);
+            nb.cells[dr][dc+1] = rows[dr] && c >= 0 ? rows[dr][c] : outside;
+        }
+    }
+}
+
+#endif
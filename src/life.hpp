@@ -0,0 +1,95 @@
+#ifndef LIFE_HPP
+#define LIFE_HPP
+
+#include <stdlib.h>
+#include <string>
+#define cimg_use_png
+
+#include "./cimg/CImg.h"
+#include "boundary.hpp"
+
+/**
+ * Life-like rule in the B/S notation, B3/S23 is the game of life
+ */
+struct LifeRule {
+    unsigned birth = 1u << 3;                   //bit k: a dead cell with k live neighbours becomes alive
+    unsigned survive = (1u << 2) | (1u << 3);   //bit k: a live cell with k live neighbours stays alive
+
+    /**
+     * @return false if s is not in the B/S notation
+     */
+    static bool parse(std::string const& s, LifeRule& r){
+        r.birth = r.survive = 0;
+        size_t slash = s.find('/');
+        if(slash == std::string::npos || s[0] != 'B' || s[slash+1] != 'S') return false;
+        for(size_t i=1; i<slash; i++){
+            if(s[i] < '0' || s[i] > '8') return false;
+            r.birth |= 1u << (s[i] - '0');
+        }
+        for(size_t i=slash+2; i<s.size(); i++){
+            if(s[i] < '0' || s[i] > '8') return false;
+            r.survive |= 1u << (s[i] - '0');
+        }
+        return true;
+    }
+
+    /**
+     * @return the rule in the B/S notation
+     */
+    std::string name() const {
+        std::string s = "B";
+        for(int k=0; k<=8; k++) if(birth >> k & 1) s += char('0' + k);
+        s += "/S";
+        for(int k=0; k<=8; k++) if(survive >> k & 1) s += char('0' + k);
+        return s;
+    }
+
+    template <class T>
+    inline T operator()(Moore<T> const& nb) const {
+        int sum = nb(-1, -1) + nb(-1, 0) + nb(-1, 1) + nb(0, -1) + nb(0, 1)
+                + nb(1, -1) + nb(1, 0) + nb(1, 1);
+        return ((nb(0, 0) ? survive : birth) >> sum) & 1;
+    }
+};
+
+/**
+ * Life-like automaton with the states 0 and 1, drawn black and white, on
+ * top of an automaton running the grid: CellularAutomata of ca.hpp or
+ * BlockAutomata of distributed.cpp
+ * @tparam Base automaton derived from Automaton
+ */
+template <class Base>
+class Life : public Base {
+    typedef typename Base::state T;
+    typedef typename Base::pixel C;
+
+    public:
+    LifeRule life; //B3/S23 unless set before the run
+
+    using Base::Base;
+
+    T rule(Moore<T> const& nb){
+        return life(nb);
+    }
+
+    void repr(cimg_library::CImg<C> &img, int const& i, int const &j, T const& s){
+        img(j,i)= s==0 ? 0 : 255; //black & white
+    }
+
+    cimg_library::CImg<C> imgBuilder(int const& n, int const &m){
+        return cimg_library::CImg<C>(m, n); //row-major, as the grid
+    }
+
+    std::string ruleName(){
+        return life.name();
+    }
+};
+
+/**
+ * @return random number 0 or 1
+ */
+inline int random_init(){
+    return (rand())%2;
+}
+
+#endif
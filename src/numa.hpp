@@ -0,0 +1,119 @@
+#ifndef NUMA_HPP
+#define NUMA_HPP
+
+#include <numa.h>
+#include <numaif.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+/**
+ * Assigns workers to NUMA nodes in contiguous blocks, so consecutive ranges
+ * of the grid live on the same node, and collects the compute time of each
+ * worker to report the bandwidth reached on every node
+ */
+class NumaLayout {
+    int _nworkers;
+    int _nodes;
+    std::vector<int> nodeOf;         //node of each worker
+    std::vector<long> computeTime;   //usec spent computing by each worker
+    std::vector<long> bytes;         //bytes read and written by each worker
+    std::vector<long> local;         //sampled pages of the worker found on its node
+    std::vector<long> sampled;
+
+    public:
+    NumaLayout(int nworkers) : _nworkers(nworkers), nodeOf(nworkers),
+        computeTime(nworkers, 0), bytes(nworkers, 0), local(nworkers, 0), sampled(nworkers, 0){
+        _nodes = numa_available() < 0 ? 1 : numa_max_node() + 1;
+        for(int i=0; i<_nworkers; i++) nodeOf[i] = i * _nodes / _nworkers;
+    }
+
+    /**
+     * @return number of elements of type T in a page
+     */
+    template <class T>
+    static inline long pageElems(){
+        return std::max(1L, long(sysconf(_SC_PAGESIZE) / sizeof(T)));
+    }
+
+    /**
+     * Rounds a range boundary to the page, so no page is shared by two workers
+     * @param k flat index of the boundary
+     * @param size number of cells of the grid
+     */
+    template <class T>
+    static inline long alignToPage(long const& k, long const& size){
+        if(k >= size) return size;
+        long p = pageElems<T>();
+        return std::min(size, (k + p/2) / p * p);
+    }
+
+    /**
+     * Pins the calling thread to the node of worker w and makes it allocate there
+     */
+    void bind(int const& w){
+        if(_nodes == 1) return;
+        numa_run_on_node(nodeOf[w]);
+        numa_set_preferred(nodeOf[w]);
+    }
+
+    /**
+     * Checks on which node the pages of the range of worker w have been placed,
+     * at most 64 pages are sampled
+     */
+    template <class T>
+    void sample(int const& w, const T* grid, long const& start, long const& end){
+        if(_nodes == 1 || start >= end) return;
+        long pageSize = sysconf(_SC_PAGESIZE);
+        char* first = (char*)(grid + start);
+        long npages = ((char*)(grid + end) - first + pageSize - 1) / pageSize;
+        long stride = std::max(1L, npages / 64);
+        std::vector<void*> pages;
+        for(long p=0; p<npages; p+=stride) pages.push_back(first + p*pageSize);
+        std::vector<int> status(pages.size());
+        if(move_pages(0, pages.size(), pages.data(), NULL, status.data(), 0) != 0) return;
+        for(int s : status){
+            sampled[w]++;
+            if(s == nodeOf[w]) local[w]++;
+        }
+    }
+
+    /**
+     * Accounts the work done by worker w
+     * @param usec time spent computing
+     * @param nbytes bytes read and written
+     */
+    inline void account(int const& w, long const& usec, long const& nbytes){
+        computeTime[w] += usec;
+        bytes[w] += nbytes;
+    }
+
+    /**
+     * Prints for each node the bandwidth, computed as the bytes moved by its
+     * workers over the compute time of the slowest one, and the fraction of
+     * sampled pages that are local
+     */
+    void printStats(std::ostream& os){
+        for(int node=0; node<_nodes; node++){
+            long nb = 0, t = 0, l = 0, s = 0;
+            int nw = 0;
+            for(int i=0; i<_nworkers; i++){
+                if(nodeOf[i] != node) continue;
+                nw++;
+                nb += bytes[i];
+                t = std::max(t, computeTime[i]);
+                l += local[i];
+                s += sampled[i];
+            }
+            if(nw == 0) continue;
+            os << "node " << node << ": workers " << nw
+               << " bandwidth " << (t > 0 ? double(nb) / t : 0) << " MB/s";
+            if(s > 0) os << " local pages " << 100.0 * l / s << "%";
+            os << std::endl;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef PARTITION_HPP
+#define PARTITION_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <string>
+#include <vector>
+
+/**
+ * Range boundaries are multiples of this number of cells, see rowGroup: with 64-byte aligned
+ * buffers they fall on a cache line boundary for any state or pixel type,
+ * so two workers never write the same line
+ */
+const int LINE_CELLS = 64;
+
+/**
+ * @return rows of a group starting on a multiple of LINE_CELLS, 1 if m is a
+ * multiple of it and up to LINE_CELLS for an odd m: a boundary every that
+ * many rows is both a whole row and a cache line boundary
+ */
+inline int lineRows(int const& m){
+    return LINE_CELLS / std::gcd(m, LINE_CELLS);
+}
+
+/**
+ * Largest group of rows, as a fraction of the share of a worker, whose
+ * boundaries are kept on a cache line: rounding to coarser groups would
+ * unbalance the workers more than the false sharing it removes
+ */
+const int GROUPS_PER_SHARE = 8;
+
+/**
+ * @return rows of the groups the boundaries of nworkers stripes are rounded
+ * to: lineRows if a share holds enough of them, else 1, and the boundaries are
+ * on whole rows only, sharing at most one cache line with the next stripe
+ */
+inline int rowGroup(int const& n, int const& m, int const& nworkers){
+    int g = lineRows(m);
+    return long(g) * nworkers * GROUPS_PER_SHARE <= n ? g : 1;
+}
+
+/**
+ * @param row position of the boundary in rows, rounded to the nearest group
+ * of g rows, or to the end of the grid
+ * @param g rows of a group, see rowGroup
+ * @return first cell of the boundary
+ */
+inline long alignedRow(double const& row, int const& n, int const& m, int const& g){
+    long r = std::lround(row / g) * g;
+    return std::min(long(n), std::max(0L, r)) * m;
+}
+
+/**
+ * Splits the n*m cells in equal flat ranges, boundaries can fall anywhere
+ * in a row or in a cache line
+ * @param ranges one range [start, end) for each worker
+ */
+template <class R>
+inline void flatPartition(std::vector<R>& ranges, int const& n, int const& m){
+    int nworkers = ranges.size();
+    long cells = long(n) * m;
+    long delta { cells / nworkers }; //work load for each worker
+    for(int i=0; i<nworkers; i++) {
+        ranges[i].start = i*delta;
+        ranges[i].end   = (i != (nworkers-1) ? (i+1)*delta : cells);
+    }
+}
+
+/**
+ * Gives each worker an equal share of whole rows, each boundary rounded to
+ * the nearest row starting on a cache line when the groups of rows between
+ * them are small enough, see rowGroup. A worker that gets no row (more
+ * workers than rows) gets an empty range.
+ * @param ranges one range [start, end) for each worker
+ */
+template <class R>
+inline void rowPartition(std::vector<R>& ranges, int const& n, int const& m){
+    int nworkers = ranges.size();
+    int g = rowGroup(n, m, nworkers);
+    auto boundary = [&](int i){
+        if(i == nworkers) return long(n) * m;
+        return alignedRow(double(i) * n / nworkers, n, m, g);
+    };
+    for(int i=0; i<nworkers; i++) {
+        ranges[i].start = boundary(i);
+        ranges[i].end   = boundary(i+1);
+    }
+}
+
+/**
+ * Gives each worker an equal share of whole rows, boundaries on the first
+ * cell of a row whatever the cache lines, for the in-place update
+ * @param ranges one range [start, end) for each worker
+ */
+template <class R>
+inline void wholeRowPartition(std::vector<R>& ranges, int const& n, int const& m){
+    int nworkers = ranges.size();
+    for(int i=0; i<nworkers; i++) {
+        ranges[i].start = long(i) * n / nworkers * m;
+        ranges[i].end   = long(i+1) * n / nworkers * m;
+    }
+}
+
+/**
+ * Computes the ranges with the partitioning named flat or aligned
+ * @return false if the name is unknown
+ */
+template <class R>
+inline bool partition(std::string const& kind, std::vector<R>& ranges, int const& n, int const& m){
+    if(kind == "flat") flatPartition(ranges, n, m);
+    else if(kind == "aligned") rowPartition(ranges, n, m);
+    else return false;
+    return true;
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef REBALANCE_HPP
+#define REBALANCE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "partition.hpp"
+
+/**
+ * Feedback-driven repartitioning for rules whose cost is not uniform over
+ * the cells. Every generation each worker records how long its range took,
+ * after the generation barrier every worker computes the same new row
+ * boundaries, moving them towards an equal share of the measured cost.
+ *
+ * The boundaries are recomputed by each worker from the shared costs, which
+ * are double buffered on the parity of the generation: the costs of
+ * generation g are only overwritten in generation g+2, after everyone has
+ * passed the barrier of g+1. No other synchronization than the barrier is
+ * needed and no worker ever writes the range of another one.
+ */
+class Rebalancer {
+    static constexpr double TOLERANCE = 0.05; //max/mean cost ratio accepted without moving
+    static constexpr double DAMPING = 0.5;    //fraction of the distance covered by a move
+
+    struct alignas(64) padded {
+        long nsec = 0;
+    };
+
+    struct alignas(64) view {
+        std::vector<long> bounds; //boundaries as seen by the worker, nworkers+1
+        std::vector<long> next;   //boundaries being computed, swapped with bounds
+    };
+
+    int _n;
+    int _m;
+    int _nworkers;
+    int _group; //rows the boundaries are rounded to
+    std::vector<padded> cost[2]; //cost[g%2][w] is the time of worker w in generation g
+    std::vector<view> local;
+    long rebalances = 0;         //updated by worker 0 only
+    double imbalance = 1;        //max/mean ratio of the last generation
+
+    /**
+     * Rounds a flat index to the nearest boundary of the groups of rows used
+     * by rowPartition
+     */
+    inline long toBoundary(double k){
+        return alignedRow(k / _m, _n, _m, _group);
+    }
+
+    public:
+    /**
+     * @param ranges initial ranges [start, end) of the workers
+     * @param n rows
+     * @param m columns
+     */
+    template <class R>
+    Rebalancer(std::vector<R> const& ranges, int const& n, int const& m)
+        : _n(n), _m(m), _nworkers(ranges.size()), _group(rowGroup(n, m, ranges.size())), local(ranges.size()){
+        cost[0] = cost[1] = std::vector<padded>(_nworkers);
+        std::vector<long> bounds;
+        for(auto& r : ranges) bounds.push_back(r.start);
+        bounds.push_back(ranges.back().end);
+        for(auto& v : local){
+            v.bounds = bounds;
+            v.next = bounds;
+        }
+    }
+
+    /**
+     * Records the time worker w spent computing generation g
+     */
+    inline void record(int const& w, int const& g, long const& nsec){
+        cost[g % 2][w].nsec = nsec;
+    }
+
+    /**
+     * Computes the boundaries for generation g+1, must be called by every
+     * worker after the barrier of generation g
+     * @param r the range of worker w, updated
+     * @return true if the range of w has changed
+     */
+    template <class R>
+    bool update(int const& w, int const& g, R& r){
+        std::vector<long>& b = local[w].bounds;
+        std::vector<padded>& c = cost[g % 2];
+        double total = 0, max = 0;
+        for(auto& x : c){
+            total += x.nsec;
+            max = std::max(max, double(x.nsec));
+        }
+        if(total <= 0) return false;
+        double ratio = max * _nworkers / total;
+        if(w == 0) imbalance = ratio;
+        if(ratio < 1 + TOLERANCE) return false;
+
+        //the cost of a range is spread evenly over its cells, the new boundary i
+        //is where the cumulative cost reaches i/nworkers of the total
+        std::vector<long>& next = local[w].next;
+        next[0] = b[0];
+        next[_nworkers] = b[_nworkers];
+        int d = 0;
+        double cum = 0;
+        for(int i=1; i<_nworkers; i++){
+            double goal = total * i / _nworkers;
+            while(d < _nworkers && cum + c[d].nsec < goal){
+                cum += c[d].nsec;
+                d++;
+            }
+            double target = b[_nworkers];
+            if(d < _nworkers){
+                target = b[d];
+                if(c[d].nsec > 0) target += (goal - cum) / c[d].nsec * (b[d+1] - b[d]);
+            }
+            next[i] = std::max(next[i-1], toBoundary(b[i] + (target - b[i]) * DAMPING));
+        }
+        if(next == b) return false;
+        b.swap(next);
+        if(w == 0) rebalances++;
+        bool changed = r.start != b[w] || r.end != b[w+1];
+        r.start = b[w];
+        r.end = b[w+1];
+        return changed;
+    }
+
+    /**
+     * Prints the number of repartitionings and the last cost imbalance
+     */
+    void printStats(std::ostream& os){
+        os << "rebalances " << rebalances << " last imbalance " << imbalance << std::endl;
+        for(int w=0; w<_nworkers; w++){
+            os << "worker " << w << ": range [" << local[0].bounds[w] << ", "
+               << local[0].bounds[w+1] << ")" << std::endl;
+        }
+    }
+};
+
+#endif
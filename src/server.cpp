@@ -0,0 +1,377 @@
+#include <stdlib.h>
+#include <iostream>
+#include <stdio.h>
+#include <functional>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstdint>
+#include <getopt.h>
+#include "ca.hpp"
+#include "life.hpp"
+
+using namespace std;
+using namespace cimg_library;
+
+/**
+ * Grid buffers kept across jobs: a released buffer is cached and handed to
+ * the next job of a similar size instead of going back to the allocator
+ */
+class BufferArena {
+    public:
+    typedef struct {
+        unsigned char* data;
+        size_t size;
+    } buffer;
+
+    private:
+    mutex mtx;
+    multimap<size_t, unsigned char*> cache; //size -> free buffer
+    size_t cached = 0; //bytes in the cache
+    size_t _limit;     //bytes kept at most
+    long hits = 0;
+    long misses = 0;
+
+    static unsigned char* allocate(size_t size){
+        void* p = nullptr;
+        if(posix_memalign(&p, sysconf(_SC_PAGESIZE), max<size_t>(size, 1)) != 0) throw bad_alloc();
+        return static_cast<unsigned char*>(p);
+    }
+
+    public:
+    /**
+     * @param limit bytes of free buffers kept in the cache
+     */
+    BufferArena(size_t limit) : _limit(limit){}
+
+    ~BufferArena(){
+        for(auto& b : cache) free(b.second);
+    }
+
+    /**
+     * Allocates count buffers of size bytes up front
+     */
+    void prealloc(size_t size, int count){
+        for(int i=0; i<count; i++) release(buffer{allocate(size), size});
+    }
+
+    /**
+     * @return a buffer of at least size bytes, a cached one if at most twice as large
+     */
+    buffer acquire(size_t size){
+        {
+            lock_guard<mutex> lock(mtx);
+            auto it = cache.lower_bound(size);
+            if(it != cache.end() && it->first <= 2 * max<size_t>(size, 1)){
+                buffer b{it->second, it->first};
+                cached -= it->first;
+                cache.erase(it);
+                hits++;
+                return b;
+            }
+            misses++;
+        }
+        return buffer{allocate(size), size};
+    }
+
+    void release(buffer b){
+        lock_guard<mutex> lock(mtx);
+        //the largest buffers are dropped first to stay in the limit
+        cache.emplace(b.size, b.data);
+        cached += b.size;
+        while(cached > _limit && !cache.empty()){
+            auto last = prev(cache.end());
+            cached -= last->first;
+            free(last->second);
+            cache.erase(last);
+        }
+    }
+
+    void printStats(ostream& os){
+        lock_guard<mutex> lock(mtx);
+        os << "arena: hits " << hits << " misses " << misses
+           << " cached " << cached / 1024 << " KB" << endl;
+    }
+};
+
+/**
+ * Runs the generations of the automaton on the pool, its frames are written
+ * meanwhile by its own writer threads, not by the workers of the pool
+ * @param alive set to the live cells of the last generation
+ */
+template <class A>
+Task simulate(A& ca, int iterations, long& alive){
+    auto gens = ca.generations(iterations);
+    Snapshot<unsigned char> last = ca.snapshot();
+    while(const Snapshot<unsigned char>* s = co_await gens.next()) last = *s;
+    alive = count(last.cells, last.cells + long(last.n) * last.m, 1);
+}
+
+/**
+ * Runs the job on the grids with the boundary policy B and saves the final
+ * state as a png if result is set
+ * @return live cells of the last generation
+ */
+template <class B>
+long runJob(BufferArena::buffer* grids, int n, int m, int iterations, LifeRule const& rule,
+            caConfig const& cfg, string const& result, StepPool& pool){
+    Life<CellularAutomata<unsigned char, unsigned char, B>> ca(grids[0].data, grids[1].data, n, m, iterations, cfg);
+    ca.life = rule;
+    ca.initAsync(pool);
+    long alive = 0;
+    syncWait(simulate(ca, iterations, alive));
+    ca.finish();
+    if(!result.empty()){
+        auto s = ca.snapshot();
+        auto img = ca.imgBuilder(n, m);
+        for(int i=0; i<n; i++)
+            for(int j=0; j<m; j++) ca.repr(img, i, j, s.cells[long(i)*m + j]);
+        img.save(result.c_str());
+    }
+    return alive;
+}
+
+/**
+ * Parses key=value pairs separated by spaces
+ */
+map<string, string> parseRequest(string const& line){
+    map<string, string> res;
+    stringstream ss(line);
+    string kv;
+    while(ss >> kv){
+        size_t eq = kv.find('=');
+        if(eq == string::npos) res[kv] = "";
+        else res[kv.substr(0, eq)] = kv.substr(eq + 1);
+    }
+    return res;
+}
+
+/**
+ * Runs the job described by the request and returns the reply to the client.
+ * Keys: n, m, iterations, rule (B3/S23), seed (0), boundary (torus),
+ * frames (directory), result (png of the final state).
+ */
+string serve(string const& line, StepPool& pool, BufferArena& arena, int const& id){
+    auto req = parseRequest(line);
+    auto get = [&](string const& k, string const& def){ return req.count(k) ? req[k] : def; };
+    int n = atoi(get("n", "0").c_str());
+    int m = atoi(get("m", "0").c_str());
+    int iterations = atoi(get("iterations", "0").c_str());
+    unsigned seed = strtoul(get("seed", "0").c_str(), nullptr, 10);
+    LifeRule rule;
+    if(n <= 0 || m <= 0 || iterations < 0) return "error n, m and iterations are required";
+    string size = caConfig::checkGrid(n, m, sizeof(unsigned char));
+    if(!size.empty()) return "error " + size;
+    if(!LifeRule::parse(get("rule", "B3/S23"), rule)) return "error rule must be like B3/S23";
+    string boundary = get("boundary", Torus::name);
+    if(!withBoundary(boundary, [](auto){})) return "error unknown boundary";
+    string frames = get("frames", "");
+    #ifndef WIMG
+    if(!frames.empty()) return "error built without the frames";
+    #endif
+    struct stat st;
+    if(!frames.empty() && (stat(frames.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)))
+        return "error cannot write the frames in " + frames;
+    caConfig cfg;
+    cfg.frameDir = frames.empty() ? "" : frames + "/";
+    cfg.frameWriters = 1; //the workers of the pool render the frames, one thread of the job writes them
+    string result = get("result", "");
+    auto start = chrono::steady_clock::now();
+    BufferArena::buffer grids[2];
+    for(auto& g : grids) g = arena.acquire(size_t(n) * m);
+    //same initial state as the other backends seeded with srand(seed)
+    char state[128];
+    random_data rd{};
+    initstate_r(seed, state, sizeof(state), &rd);
+    for(long i=0; i<long(n)*m; i++){
+        int32_t r;
+        random_r(&rd, &r);
+        grids[0].data[i] = r % 2;
+    }
+    string reply;
+    try {
+        long alive = 0;
+        withBoundary(boundary, [&](auto b){
+            alive = runJob<decltype(b)>(grids, n, m, iterations, rule, cfg, result, pool); });
+        auto usec = chrono::duration_cast<chrono::microseconds>(
+            chrono::steady_clock::now() - start).count();
+        reply = "ok job " + to_string(id) + " computed in " + to_string(usec) + " usec, "
+              + to_string(alive) + " alive";
+    } catch(CImgException const& e) {
+        reply = string("error ") + e.what();
+    } catch(runtime_error const& e) {
+        reply = string("error ") + e.what();
+    }
+    for(auto& g : grids) arena.release(g);
+    return reply;
+}
+
+/**
+ * Reads a line from the socket
+ * @return false if the connection is closed before the end of the line
+ */
+bool readLine(int fd, string& line){
+    line.clear();
+    char c;
+    while(read(fd, &c, 1) == 1){
+        if(c == '\n') return true;
+        line += c;
+    }
+    return !line.empty();
+}
+
+/**
+ * Writes a line to the socket, a closed connection does not raise SIGPIPE
+ * @return false if the client has gone before the whole line was sent
+ */
+bool writeLine(int fd, string const& line){
+    string s = line + "\n";
+    size_t off = 0;
+    while(off < s.size()){
+        ssize_t k = send(fd, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+        if(k < 0 && errno == EINTR) continue;
+        if(k <= 0) return false;
+        off += k;
+    }
+    return true;
+}
+
+sockaddr_un address(string const& path){
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+/**
+ * Sends a request to the server and prints the reply
+ */
+int client(string const& path, string const& request){
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = address(path);
+    if(fd < 0 || connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0){
+        perror("connect");
+        return(-1);
+    }
+    writeLine(fd, request);
+    string reply;
+    readLine(fd, reply);
+    close(fd);
+    cout << reply << endl;
+    return reply.rfind("ok", 0) == 0 || reply == "bye" ? 0 : -1;
+}
+
+int main(int argc, char* argv[]){
+    bool isClient=false;
+    size_t arenaMB=1024;
+    string prealloc;
+    static struct option options[] = {
+        {"client", no_argument, 0, 'c'},
+        {"arena", required_argument, 0, 'A'},
+        {"prealloc", required_argument, 0, 'p'},
+        {0, 0, 0, 0}
+    };
+    bool usage=false;
+    int opt;
+    while((opt = getopt_long(argc, argv, "cA:p:", options, NULL)) != -1){
+        switch(opt){
+            case 'c': isClient = true; break;
+            case 'A': arenaMB = atol(optarg); break;
+            case 'p': prealloc = optarg; break;
+            default: usage = true;
+        }
+    }
+    if(usage || (isClient ? argc - optind < 2 : argc - optind != 2)) {
+        std::cout << "Usage is: " << argv[0] << " socket number_worker [-A arena_MB] [-p NxM:count]"
+                  << std::endl
+                  << "          " << argv[0] << " -c socket n=N m=M iterations=I [rule=B3/S23]"
+                  << " [seed=S] [boundary=torus|fixed|reflective|open] [frames=dir] [result=file]"
+                  << std::endl
+                  << "          " << argv[0] << " -c socket quit" << std::endl;
+        return(-1);
+    }
+    string path = argv[optind];
+    if(isClient){
+        string request;
+        for(int i=optind+1; i<argc; i++) request += string(i > optind+1 ? " " : "") + argv[i];
+        return client(path, request);
+    }
+
+    int nw = atoi(argv[optind+1]);
+    BufferArena arena(arenaMB << 20);
+    if(!prealloc.empty()){ //two buffers for each job of that size
+        int pn = 0, pm = 0, count = 0;
+        if(sscanf(prealloc.c_str(), "%dx%d:%d", &pn, &pm, &count) != 3) {
+            std::cout << "Expected NxM:count, got " << prealloc << std::endl;
+            return(-1);
+        }
+        arena.prealloc(size_t(pn) * pm, 2 * count);
+    }
+    StepPool pool(nw);
+    signal(SIGPIPE, SIG_IGN); //a client gone before its reply only loses the reply
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = address(path);
+    unlink(path.c_str());
+    if(lfd < 0 || bind(lfd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(lfd, SOMAXCONN) < 0){
+        perror("listen");
+        return(-1);
+    }
+    cout << "listening on " << path << " with " << nw << " workers" << endl;
+
+    //one thread for each connection, the computation is done by the pool;
+    //the request is read there too, so that an idle client does not block the others
+    mutex mtx;
+    condition_variable idle;
+    int connections = 0;
+    int nextId = 0;
+    atomic<bool> quit{false};
+    while(true){
+        int fd = accept(lfd, nullptr, nullptr);
+        if(fd < 0){
+            if(quit) break; //woken by the shutdown of quit
+            continue;
+        }
+        {
+            lock_guard<mutex> lock(mtx);
+            connections++;
+        }
+        thread([&, fd](int id){
+            string line;
+            if(readLine(fd, line)){
+                if(line == "quit"){
+                    quit = true;
+                    writeLine(fd, "bye");
+                    shutdown(lfd, SHUT_RDWR); //wakes the accept
+                } else if(!writeLine(fd, serve(line, pool, arena, id))){
+                    cerr << "job " << id << ": client gone before the reply" << endl;
+                }
+            }
+            close(fd);
+            lock_guard<mutex> lock(mtx);
+            if(--connections == 0) idle.notify_all();
+        }, nextId++).detach();
+    }
+    close(lfd);
+    unlink(path.c_str());
+    //the running jobs are completed
+    unique_lock<mutex> lock(mtx);
+    idle.wait(lock, [&]{ return connections == 0; });
+    arena.printStats(cout);
+    return 0;
+}
@@ -0,0 +1,145 @@
+#ifndef SPARSE_HPP
+#define SPARSE_HPP
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "boundary.hpp"
+
+/**
+ * Cells [start, end) of a row, all in the same live state
+ */
+template <class T>
+struct Run {
+    int start;
+    int end;
+    T state;
+};
+
+/**
+ * Grid with each row kept as its runs of live cells in column order, a cell
+ * not in a run is dead (T()); the memory and the work of a generation grow
+ * with the live cells instead of the whole grid
+ */
+template <class T>
+class SparseGrid {
+    int _m;
+    std::vector<std::vector<Run<T>>> _rows;
+
+    public:
+    SparseGrid(int const& n = 0, int const& m = 0) : _m(m), _rows(n){}
+
+    inline std::vector<Run<T>>& row(int const& r){ return _rows[r]; }
+    inline std::vector<Run<T>> const& row(int const& r) const { return _rows[r]; }
+
+    /**
+     * Encodes the rows [first, last) of the dense grid
+     * @return live cells of the rows
+     */
+    long fromDense(const T* grid, int const& first, int const& last){
+        long live = 0;
+        for(int r=first; r<last; r++){
+            auto& runs = _rows[r];
+            runs.clear();
+            const T* cells = grid + long(r) * _m;
+            for(int c=0; c<_m; c++){
+                if(cells[c] == T()) continue;
+                live++;
+                if(!runs.empty() && runs.back().end == c && runs.back().state == cells[c]) runs.back().end++;
+                else runs.push_back(Run<T>{c, c+1, cells[c]});
+            }
+        }
+        return live;
+    }
+
+    /**
+     * Decodes the rows [first, last) in the dense grid
+     */
+    void toDense(T* grid, int const& first, int const& last) const {
+        for(int r=first; r<last; r++){
+            T* cells = grid + long(r) * _m;
+            std::fill(cells, cells + _m, T());
+            for(auto& run : _rows[r]) std::fill(cells + run.start, cells + run.end, run.state);
+        }
+    }
+};
+
+/**
+ * Computes the runs of a row of the next generation from the runs of the
+ * three rows it reads. Only the columns next to a live cell, and the edge
+ * columns whose neighbours come from the boundary, are evaluated: the others
+ * see only dead cells and stay dead, which needs a quiescent rule. The input
+ * runs are expanded in dense lines that are cleared again afterwards, so a
+ * row costs its live cells, not its width. One for each worker.
+ * @tparam T state type
+ */
+template <class T>
+class RunKernel {
+    int _m;
+    std::vector<T> lines[3]; //rows above, the row, below; dead outside the runs being read
+    std::vector<std::pair<int, int>> spans; //columns to evaluate
+
+    public:
+    RunKernel(int const& m = 0) : _m(m){
+        for(auto& l : lines) l.assign(m, T());
+    }
+
+    /**
+     * @param r row to compute
+     * @param out set to the runs of the row in the next generation
+     * @param rule new state of a cell
+     * @return live cells of the row in the next generation
+     */
+    template <class B, class F>
+    long step(SparseGrid<T> const& old, int const& r, int const& n, std::vector<Run<T>>& out, F&& rule){
+        out.clear();
+        spans.clear();
+        const std::vector<Run<T>>* in[3];
+        for(int dr=0; dr<3; dr++){
+            int x = B::source(r + dr - 1, n);
+            in[dr] = x < 0 ? nullptr : &old.row(x);
+            if(in[dr] == nullptr) continue;
+            for(auto& run : *in[dr]){
+                std::fill(lines[dr].begin() + run.start, lines[dr].begin() + run.end, run.state);
+                spans.emplace_back(std::max(0, run.start - 1), std::min(_m, run.end + 1));
+            }
+        }
+        if(spans.empty()) return 0;
+        spans.emplace_back(0, 1);
+        spans.emplace_back(_m - 1, _m);
+        std::sort(spans.begin(), spans.end());
+
+        long live = 0;
+        Moore<T> nb;
+        int c = 0; //next column to evaluate
+        for(auto& s : spans){
+            for(c = std::max(c, s.first); c < s.second; c++){
+                if(c > 0 && c < _m - 1){
+                    for(int dr=0; dr<3; dr++){
+                        const T* l = lines[dr].data() + c;
+                        nb.cells[dr][0] = l[-1]; nb.cells[dr][1] = l[0]; nb.cells[dr][2] = l[1];
+                    }
+                } else {
+                    for(int dr=0; dr<3; dr++){
+                        for(int dc=-1; dc<=1; dc++){
+                            int col = B::source(c + dc, _m);
+                            nb.cells[dr][dc+1] = col < 0 ? T() : lines[dr][col];
+                        }
+                    }
+                }
+                T res = rule(nb);
+                if(res == T()) continue;
+                live++;
+                if(!out.empty() && out.back().end == c && out.back().state == res) out.back().end++;
+                else out.push_back(Run<T>{c, c+1, res});
+            }
+        }
+        for(int dr=0; dr<3; dr++){
+            if(in[dr] == nullptr) continue;
+            for(auto& run : *in[dr]) std::fill(lines[dr].begin() + run.start, lines[dr].begin() + run.end, T());
+        }
+        return live;
+    }
+};
+
+#endif
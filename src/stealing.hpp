@@ -0,0 +1,158 @@
+#ifndef STEALING_HPP
+#define STEALING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+/**
+ * Work-stealing scheduler of row tiles for a fixed set of workers.
+ * Every generation each worker refills its own deque with the tiles of its
+ * share of the grid, pops them from the front and, once it is empty, steals
+ * from the back of the other deques before reaching the generation barrier.
+ */
+class TileScheduler {
+    public:
+    typedef struct {
+        long start;
+        long end;
+    } tile;
+
+    private:
+    /**
+     * Deque of a worker, the tiles are the indexes in [first+head, first+tail).
+     * head and tail are packed in a single word so that the owner and the
+     * thieves can both update it with a CAS.
+     */
+    struct alignas(64) deque {
+        std::atomic<uint64_t> bounds{0};
+        int first = 0;
+        int count = 0;
+        long tiles = 0;     //tiles computed by the worker
+        long steals = 0;    //tiles taken from other deques
+        long idle = 0;      //usec spent without work before the barrier
+    };
+
+    int _n;
+    int _m;
+    int _tileRows;
+    int _nTiles;
+    int _nworkers;
+    std::vector<deque> deques;
+
+    static inline uint64_t pack(uint32_t head, uint32_t tail){
+        return (uint64_t(tail) << 32) | head;
+    }
+    static inline uint32_t head(uint64_t b){ return uint32_t(b); }
+    static inline uint32_t tail(uint64_t b){ return uint32_t(b >> 32); }
+
+    inline tile tileAt(int t){
+        int end = std::min(_n, (t+1)*_tileRows);
+        return tile{long(t)*_tileRows*_m, long(end)*_m};
+    }
+
+    /**
+     * Takes the first tile of the deque
+     */
+    inline bool popFront(deque& d, int& t){
+        uint64_t b = d.bounds.load(std::memory_order_acquire);
+        while(head(b) < tail(b)){
+            if(d.bounds.compare_exchange_weak(b, pack(head(b)+1, tail(b)),
+                                              std::memory_order_acq_rel)){
+                t = d.first + head(b);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Takes the last tile of the deque
+     */
+    inline bool popBack(deque& d, int& t){
+        uint64_t b = d.bounds.load(std::memory_order_acquire);
+        while(head(b) < tail(b)){
+            if(d.bounds.compare_exchange_weak(b, pack(head(b), tail(b)-1),
+                                              std::memory_order_acq_rel)){
+                t = d.first + tail(b) - 1;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    public:
+    /**
+     * @param n rows
+     * @param m columns
+     * @param nworkers number of workers
+     * @param tileRows rows in each tile
+     */
+    TileScheduler(int n, int m, int nworkers, int tileRows)
+        : _n(n), _m(m), _tileRows(tileRows), _nworkers(nworkers), deques(nworkers){
+        _nTiles = (_n + _tileRows - 1) / _tileRows;
+        int delta = _nTiles / _nworkers;
+        int rest = _nTiles % _nworkers;
+        for(int i=0; i<_nworkers; i++){
+            deques[i].first = i*delta + std::min(i, rest);
+            deques[i].count = delta + (i < rest);
+        }
+    }
+
+    /**
+     * Puts back in the deque of the worker all its tiles, must be called by
+     * the owner at the beginning of each generation
+     */
+    inline void reset(int const& w){
+        deques[w].bounds.store(pack(0, deques[w].count), std::memory_order_release);
+    }
+
+    /**
+     * Gets the next tile the worker has to compute for the current generation
+     * @return false when no tile is left in any deque
+     */
+    inline bool next(int const& w, tile& res){
+        int t;
+        if(popFront(deques[w], t)){
+            deques[w].tiles++;
+            res = tileAt(t);
+            return true;
+        }
+        for(int k=1; k<_nworkers; k++){
+            if(popBack(deques[(w+k) % _nworkers], t)){
+                deques[w].tiles++;
+                deques[w].steals++;
+                res = tileAt(t);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Accounts time the worker spent waiting for the others
+     */
+    inline void addIdle(int const& w, long const& usec){
+        deques[w].idle += usec;
+    }
+
+    /**
+     * Prints tiles, steals and idle time of each worker
+     */
+    void printStats(std::ostream& os){
+        long steals = 0, idle = 0;
+        for(int i=0; i<_nworkers; i++){
+            os << "worker " << i << ": tiles " << deques[i].tiles
+               << " steals " << deques[i].steals
+               << " idle " << deques[i].idle << " usec" << std::endl;
+            steals += deques[i].steals;
+            idle += deques[i].idle;
+        }
+        os << "total steals " << steals << " idle " << idle << " usec" << std::endl;
+    }
+};
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef STEPPOOL_HPP
+#define STEPPOOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Automaton stepped by a StepPool: each generation is split in chunks,
+ * which are computed by any worker of the pool
+ */
+class PoolJob {
+    friend class StepPool;
+
+    int remaining = 0; //generations to step before leaving the pool
+    int next = 0; //chunks of the generation handed out
+    int done = 0; //chunks of the generation completed
+    std::function<void()> reached; //called when no generation remains
+
+    public:
+    /**
+     * Cells of a chunk, about the same for all the jobs so that the round
+     * robin among jobs is fair
+     */
+    static constexpr int CHUNK_CELLS = 1 << 15;
+
+    virtual ~PoolJob(){}
+
+    /**
+     * @return chunks of a generation
+     */
+    virtual int chunks()=0;
+
+    /**
+     * Computes the chunk c of the current generation
+     */
+    virtual void computeChunk(int const& c)=0;
+
+    /**
+     * Moves to the next generation, called once all its chunks are computed
+     */
+    virtual void advance()=0;
+};
+
+/**
+ * Persistent pool of workers shared by all the jobs. Workers take one chunk
+ * at a time from the active jobs in round robin, so concurrent jobs advance
+ * at the same rate in cells whatever their size.
+ */
+class StepPool {
+    std::mutex mtx;
+    std::condition_variable work; //a chunk is available or the pool stops
+    std::vector<PoolJob*> active;
+    size_t rr = 0; //next job of the round robin
+    bool stop = false;
+    std::vector<std::thread> workers;
+
+    /**
+     * @return the next job with a chunk to hand out, nullptr if none
+     */
+    PoolJob* pick(){
+        for(size_t k=0; k<active.size(); k++){
+            PoolJob* j = active[(rr + k) % active.size()];
+            if(j->next < j->chunks()){
+                rr = (rr + k + 1) % active.size();
+                return j;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * Starts the next generation or, at the last one, removes the job and
+     * calls its continuation in the worker that completed the generation
+     */
+    void advance(PoolJob* j){
+        std::function<void()> reached;
+        j->advance();
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            j->next = j->done = 0;
+            if(--j->remaining > 0){
+                work.notify_all();
+                return;
+            }
+            active.erase(std::find(active.begin(), active.end(), j));
+            reached.swap(j->reached);
+        }
+        reached();
+    }
+
+    void loop(){
+        std::unique_lock<std::mutex> lock(mtx);
+        while(true){
+            PoolJob* j = nullptr;
+            work.wait(lock, [&]{ return stop || (j = pick()) != nullptr; });
+            if(j == nullptr) return;
+            int c = j->next++;
+            lock.unlock();
+            j->computeChunk(c);
+            lock.lock();
+            if(++j->done < j->chunks()) continue;
+            lock.unlock();
+            advance(j);
+            lock.lock();
+        }
+    }
+
+    public:
+    StepPool(int nworkers){
+        for(int i=0; i<nworkers; i++) workers.emplace_back([this]{ loop(); });
+    }
+
+    ~StepPool(){
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        work.notify_all();
+        for(auto& w : workers) w.join();
+    }
+
+    /**
+     * Computes k > 0 more generations of the job on the pool, then calls
+     * reached in the worker that completed the last one
+     */
+    void submit(PoolJob* j, int const& k, std::function<void()> reached){
+        std::lock_guard<std::mutex> lock(mtx);
+        j->remaining = k;
+        j->reached = std::move(reached);
+        active.push_back(j);
+        work.notify_all();
+    }
+};
+
+#endif
@@ -0,0 +1,388 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "./cimg/CImg.h"
+#include "framewriter.hpp"
+
+/**
+ * Frame stream: all the frames of a run in one file instead of one png each.
+ *
+ * Layout: the header, the frames appended in the order they are written,
+ * then the index with the offset of each frame by generation and the footer
+ * pointing to it. A frame holds the values of the image, rows x cols x
+ * channels of valueBytes each, optionally packed to one bit per value when
+ * they are all 0 or 255 and compressed with zlib.
+ *
+ * With keyframes K, only the generations multiple of K hold the values; the
+ * others hold the XOR of their values with the previous generation, mostly
+ * zeros that compress to little, so generation j is rebuilt from the last
+ * keyframe before it and the deltas up to j.
+ */
+struct StreamHeader {
+    char magic[8];       //"CASTRM3"
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t channels;   //values of each cell
+    uint32_t valueBytes; //bytes of a value
+    uint32_t keyframes;  //generations from a full frame to the next, 0 if all are full
+    char rule[32];       //rule of the automaton, as given by the writer
+    uint64_t first;      //generation of the first frame, not 0 for a run continuing a grid file
+};
+
+struct StreamEntry {
+    uint64_t offset;
+    uint64_t bytes;   //0 if the frame was not written, a keyframe of a large grid may pass 4 GiB
+    uint32_t flags;
+    uint32_t unused;
+};
+
+struct StreamFooter {
+    uint64_t index; //offset of the index
+    uint64_t frames;
+    char magic[8];
+};
+
+const uint32_t STREAM_DEFLATE = 1; //compressed with zlib
+const uint32_t STREAM_PACKED = 2;  //one bit for each value, 0 or 255
+const uint32_t STREAM_DELTA = 4;   //XOR with the previous generation
+
+/**
+ * Writes a frame stream from several threads: each frame is packed and
+ * compressed by the calling thread, then copied in a large buffer that is
+ * written to the file when full, so the file is written sequentially in
+ * large blocks whatever the frame size.
+ */
+class FrameStreamWriter {
+    static const size_t BUFFER = 8 << 20;
+
+    int fd = -1;
+    StreamHeader head;
+    std::vector<StreamEntry> index;
+    int _level;
+    bool _packBits;
+    std::mutex mtx;
+    std::vector<char> buf;
+    uint64_t offset = 0; //of the buffer in the file
+    bool failed = false;
+
+    void writeAll(const char* data, size_t bytes){
+        while(bytes > 0 && !failed){
+            ssize_t w = ::write(fd, data, bytes);
+            if(w <= 0){
+                failed = true;
+                return;
+            }
+            data += w;
+            bytes -= w;
+        }
+    }
+
+    void flush(){
+        writeAll(buf.data(), buf.size());
+        offset += buf.size();
+        buf.clear();
+    }
+
+    /**
+     * Deflate state of a thread, allocated at its first frame and reset for
+     * the next ones instead of being allocated again by each compress2
+     */
+    struct Deflater {
+        z_stream z;
+        int level = -1; //of the state, -1 before the first frame
+
+        static voidpf alloc(voidpf, uInt items, uInt size){
+            WriteAllocs::record();
+            return calloc(items, size);
+        }
+
+        static void release(voidpf, voidpf p){ free(p); }
+
+        ~Deflater(){
+            if(level >= 0) deflateEnd(&z);
+        }
+
+        /**
+         * @param size capacity of out, set to the compressed bytes
+         * @return false if the data does not fit in out
+         */
+        bool compress(unsigned char* out, uLongf& size, const unsigned char* data, size_t const& bytes, int const& lvl){
+            if(level != lvl){
+                if(level >= 0) deflateEnd(&z);
+                memset(&z, 0, sizeof(z));
+                z.zalloc = alloc;
+                z.zfree = release;
+                level = deflateInit(&z, lvl) == Z_OK ? lvl : -1;
+                if(level < 0) return false;
+            } else if(deflateReset(&z) != Z_OK){
+                return false;
+            }
+            //zlib takes at most 4 GiB at a time, in and out
+            const size_t most = std::numeric_limits<uInt>::max();
+            size_t in = bytes, room = size;
+            z.next_in = const_cast<Bytef*>(data);
+            z.next_out = out;
+            int ret = Z_OK;
+            while(ret == Z_OK){
+                if(z.avail_in == 0){
+                    z.avail_in = std::min(in, most);
+                    in -= z.avail_in;
+                }
+                if(z.avail_out == 0){
+                    z.avail_out = std::min(room, most);
+                    room -= z.avail_out;
+                }
+                ret = deflate(&z, in > 0 ? Z_NO_FLUSH : Z_FINISH);
+            }
+            size = z.total_out;
+            return ret == Z_STREAM_END;
+        }
+    };
+
+    public:
+    /**
+     * @param frames frames of the run, the generations first to first+frames-1
+     * @param first generation of the first frame, the frames are appended
+     * and read by their position from it
+     * @param rule name of the rule, saved in the header
+     * @param level zlib level, 0 to store the frames uncompressed
+     * @param packBits one bit for each value of the black and white frames
+     * @param keyframes generations from a full frame to the next, 0 if all are full
+     */
+    FrameStreamWriter(std::string const& path, int rows, int cols, int channels, int valueBytes,
+                      long frames, long first, std::string const& rule, int level = 1, bool packBits = true,
+                      int keyframes = 0)
+        : index(frames, StreamEntry{0, 0, 0, 0}), _level(level), _packBits(packBits){
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0) throw std::runtime_error("cannot create " + path);
+        memset(&head, 0, sizeof(head));
+        memcpy(head.magic, "CASTRM3", 8);
+        head.rows = rows;
+        head.cols = cols;
+        head.channels = channels;
+        head.valueBytes = valueBytes;
+        head.keyframes = std::max(0, keyframes);
+        strncpy(head.rule, rule.c_str(), sizeof(head.rule) - 1);
+        head.first = std::max(0L, first);
+        buf.reserve(BUFFER);
+        buf.insert(buf.end(), reinterpret_cast<char*>(&head), reinterpret_cast<char*>(&head) + sizeof(head));
+    }
+
+    FrameStreamWriter(FrameStreamWriter const&) = delete;
+
+    ~FrameStreamWriter(){
+        close();
+    }
+
+    /**
+     * @return true if the frame of generation j is appended as its XOR with
+     * the previous generation
+     */
+    inline bool delta(long const& j) const {
+        return head.keyframes > 0 && j % head.keyframes != 0;
+    }
+
+    /**
+     * Appends the frame of generation j, thread safe
+     * @param img the values of the frame, or their XOR with the previous
+     * generation if delta(j)
+     */
+    template <class C>
+    void append(long const& j, cimg_library::CImg<C> const& img){
+        thread_local std::vector<unsigned char> packed, compressed;
+        thread_local Deflater deflater;
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(img.data());
+        size_t bytes = img.size() * sizeof(C);
+        uint32_t flags = delta(j) ? STREAM_DELTA : 0;
+        if(_packBits && sizeof(C) == 1 && std::all_of(data, data + bytes,
+                [](unsigned char v){ return v == 0 || v == 255; })){
+            packed.assign((bytes + 7) / 8, 0);
+            for(size_t k=0; k<bytes; k++) packed[k >> 3] |= (data[k] != 0) << (7 - (k & 7));
+            data = packed.data();
+            bytes = packed.size();
+            flags |= STREAM_PACKED;
+        }
+        if(_level > 0){
+            uLongf size = compressBound(bytes);
+            compressed.resize(size);
+            if(deflater.compress(compressed.data(), size, data, bytes, _level)){
+                data = compressed.data();
+                bytes = size;
+                flags |= STREAM_DEFLATE;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        if(fd < 0 || j < 0 || j >= long(index.size())) return;
+        index[j] = StreamEntry{offset + buf.size(), bytes, flags, 0};
+        if(buf.size() + bytes > BUFFER) flush();
+        if(bytes > BUFFER){
+            writeAll(reinterpret_cast<const char*>(data), bytes);
+            offset += bytes;
+        } else {
+            buf.insert(buf.end(), data, data + bytes);
+        }
+    }
+
+    /**
+     * Writes the index and closes the file
+     * @return false if the file could not be written
+     */
+    bool close(){
+        std::lock_guard<std::mutex> lock(mtx);
+        if(fd < 0) return !failed;
+        StreamFooter foot{offset + buf.size(), index.size(), {'C','A','S','T','R','M','3','\0'}};
+        const char* entries = reinterpret_cast<const char*>(index.data());
+        buf.insert(buf.end(), entries, entries + index.size() * sizeof(StreamEntry));
+        buf.insert(buf.end(), reinterpret_cast<char*>(&foot), reinterpret_cast<char*>(&foot) + sizeof(foot));
+        flush();
+        failed = ::close(fd) != 0 || failed;
+        fd = -1;
+        return !failed;
+    }
+};
+
+/**
+ * Random access to the frames of a stream
+ */
+class FrameStreamReader {
+    int fd = -1;
+    StreamHeader head;
+    std::vector<StreamEntry> index;
+    std::vector<unsigned char> raw; //frame as stored
+    std::vector<unsigned char> inflated;
+    std::vector<unsigned char> values; //of frame last, the deltas up to a later frame are applied to it
+    long last = -1;
+
+    void readAt(void* dst, size_t bytes, uint64_t offset, std::string const& what){
+        char* to = static_cast<char*>(dst);
+        while(bytes > 0){ //a read returns at most about 2 GiB
+            ssize_t r = pread(fd, to, bytes, offset);
+            if(r <= 0) throw std::runtime_error("cannot read the " + what);
+            to += r;
+            offset += r;
+            bytes -= r;
+        }
+    }
+
+    /**
+     * Decodes frame k as stored, the values or a delta
+     * @param apply XOR the frame into out instead of copying it
+     */
+    void decode(long const& k, std::vector<unsigned char>& out, bool const& apply){
+        if(!has(k)) throw std::runtime_error("frame " + std::to_string(k) + " is not in the stream");
+        auto& e = index[k];
+        raw.resize(e.bytes);
+        readAt(raw.data(), e.bytes, e.offset, "frame " + std::to_string(k));
+        size_t bytes = frameBytes();
+        size_t stored = e.flags & STREAM_PACKED ? (bytes + 7) / 8 : bytes;
+        const unsigned char* data = raw.data();
+        if(e.flags & STREAM_DEFLATE){
+            inflated.resize(stored);
+            uLongf size = stored;
+            if(uncompress(inflated.data(), &size, raw.data(), raw.size()) != Z_OK || size != stored)
+                throw std::runtime_error("frame " + std::to_string(k) + " is corrupted");
+            data = inflated.data();
+        } else if(raw.size() != stored){
+            throw std::runtime_error("frame " + std::to_string(k) + " is corrupted");
+        }
+        out.resize(bytes);
+        for(size_t i=0; i<bytes; i++){
+            unsigned char v = e.flags & STREAM_PACKED ? ((data[i >> 3] >> (7 - (i & 7))) & 1 ? 255 : 0) : data[i];
+            out[i] = apply ? out[i] ^ v : v;
+        }
+    }
+
+    public:
+    FrameStreamReader(std::string const& path){
+        fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0) throw std::runtime_error("cannot open " + path);
+        off_t size = lseek(fd, 0, SEEK_END);
+        StreamFooter foot;
+        if(size < off_t(sizeof(head) + sizeof(foot))){
+            ::close(fd);
+            throw std::runtime_error(path + " is not a frame stream");
+        }
+        readAt(&head, sizeof(head), 0, "header");
+        readAt(&foot, sizeof(foot), size - sizeof(foot), "footer");
+        if(memcmp(head.magic, "CASTRM3", 8) != 0 || memcmp(foot.magic, "CASTRM3", 8) != 0){
+            ::close(fd);
+            throw std::runtime_error(path + " is not a frame stream or was not closed");
+        }
+        //the index is right before the footer and the frames before the index
+        uint64_t end = size - sizeof(foot);
+        if(foot.index < sizeof(head) || foot.index > end || foot.frames != (end - foot.index) / sizeof(StreamEntry)
+           || (end - foot.index) % sizeof(StreamEntry) != 0){
+            ::close(fd);
+            throw std::runtime_error(path + " has a corrupt index");
+        }
+        index.resize(foot.frames);
+        readAt(index.data(), index.size() * sizeof(StreamEntry), foot.index, "index");
+        for(auto& e : index){
+            if(e.bytes > 0 && (e.offset < sizeof(head) || e.offset > foot.index || e.bytes > foot.index - e.offset)){
+                ::close(fd);
+                throw std::runtime_error(path + " has a corrupt index");
+            }
+        }
+    }
+
+    FrameStreamReader(FrameStreamReader const&) = delete;
+
+    ~FrameStreamReader(){
+        ::close(fd);
+    }
+
+    StreamHeader const& header() const { return head; }
+
+    long frames() const { return index.size(); }
+
+    /**
+     * @return bytes of the values of a frame
+     */
+    size_t frameBytes() const {
+        return size_t(head.rows) * head.cols * head.channels * head.valueBytes;
+    }
+
+    /**
+     * @return true if frame k was written
+     */
+    bool has(long const& k) const {
+        return k >= 0 && k < frames() && index[k].bytes > 0;
+    }
+
+    /**
+     * Reads the values of frame k, in the layout of the CImg frames; a delta
+     * frame is rebuilt from the last keyframe, or from the frame read before
+     * if it is between them, so reading the frames in order decodes each once
+     * @param out resized to frameBytes
+     */
+    void read(long const& k, std::vector<unsigned char>& out){
+        if(!has(k)) throw std::runtime_error("frame " + std::to_string(k) + " is not in the stream");
+        long key = k;
+        while(index[key].flags & STREAM_DELTA){
+            if(--key < 0) throw std::runtime_error("frame " + std::to_string(k) + " has no keyframe");
+        }
+        long from = last >= key && last <= k ? last : -1;
+        last = -1; //until the values hold a whole frame again
+        if(from < 0){
+            decode(key, values, false);
+            from = key;
+        }
+        for(; from < k; from++) decode(from + 1, values, true);
+        last = k;
+        out = values;
+    }
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef STRIPESYNC_HPP
+#define STRIPESYNC_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+ * Point-to-point synchronization between workers that own stripes of the grid.
+ * Each worker publishes how many generations it has completed, before computing
+ * generation g a worker only waits for the workers owning the rows it reads
+ * (usually the two adjacent stripes) to have completed g generations.
+ * Neighbouring workers can drift by at most one generation.
+ */
+class StripeSync {
+    struct alignas(64) counter {
+        std::atomic<int> gen{0}; //generations completed by the worker
+    };
+
+    std::vector<counter> done;
+    std::vector<std::vector<int>> deps; //workers each worker reads from
+
+    static inline bool intersect(long s1, long e1, long s2, long e2){
+        return s1 < e2 && s2 < e1;
+    }
+
+    public:
+    /**
+     * @param ranges flat ranges [start, end) owned by each worker
+     * @param n rows
+     * @param m columns
+     */
+    template <class R>
+    StripeSync(std::vector<R> const& ranges, int const& n, int const& m)
+        : done(ranges.size()), deps(ranges.size()){
+        int nw = ranges.size();
+        for(int i=0; i<nw; i++){
+            if(ranges[i].start >= ranges[i].end) continue;
+            //rows above and below the stripe, the first and last one wrap around
+            int r0 = ranges[i].start / m - 1;
+            int r1 = (ranges[i].end - 1) / m + 1;
+            for(int d=0; d<nw; d++){
+                if(d == i) continue;
+                long s = ranges[d].start, e = ranges[d].end;
+                bool reads = intersect(long(std::max(r0, 0))*m, long(std::min(r1+1, n))*m, s, e)
+                          || (r0 < 0 && intersect(long(n-1)*m, long(n)*m, s, e))
+                          || (r1 >= n && intersect(0, m, s, e));
+                if(reads) deps[i].push_back(d);
+            }
+        }
+    }
+
+    /**
+     * Finds the rows of [start, end) that only read cells of the range and are
+     * not read by the other workers: they can be computed before waiting for
+     * the neighbours, and written while the neighbours are still reading the
+     * edges of the range in the previous generation
+     * @param first set to the first cell of the interior
+     * @param last set to the end of the interior, first if it is empty
+     */
+    static inline void interior(long const& start, long const& end, int const& m,
+                                long& first, long& last){
+        long r0 = (start + m - 1) / m + 1; //second whole row
+        long r1 = end / m - 1;             //end of the second last whole row
+        first = start;
+        last = start;
+        if(r0 < r1){
+            first = r0 * m;
+            last = r1 * m;
+        }
+    }
+
+    /**
+     * Waits until every worker that w reads from has completed g generations
+     */
+    inline void wait(int const& w, int const& g){
+        for(int d : deps[w]){
+            int spins = 0;
+            while(done[d].gen.load(std::memory_order_acquire) < g){
+                if(++spins > 1024) std::this_thread::yield();
+            }
+        }
+    }
+
+    /**
+     * Publishes that worker w has completed g generations
+     */
+    inline void publish(int const& w, int const& g){
+        done[w].gen.store(g, std::memory_order_release);
+    }
+};
+
+#endif
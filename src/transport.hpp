@@ -0,0 +1,480 @@
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Bytes sent to or received from a peer process in an exchange
+ */
+struct Message {
+    int peer;
+    char* data;
+    size_t bytes;
+};
+
+/**
+ * Point-to-point channels between the processes of a distributed run
+ */
+class Transport {
+    public:
+    virtual ~Transport(){}
+
+    /**
+     * Sends and receives all the messages, progressing them together so that
+     * two processes sending to each other cannot block. Messages between the
+     * same pair of processes are delivered in the order they are listed.
+     */
+    virtual void exchange(std::vector<Message> const& sends, std::vector<Message> const& recvs)=0;
+
+    protected:
+    static inline void fail(std::string const& what){
+        throw std::runtime_error(what + ": " + strerror(errno));
+    }
+};
+
+/**
+ * Transport over one stream socket for each pair of peers. The lower rank
+ * listens, the higher one connects and sends its rank first.
+ */
+class SocketTransport : public Transport {
+    struct channel {
+        int fd = -1;
+        std::vector<const Message*> out, in; //of the current exchange, in the order of the lists
+        size_t nout = 0, nin = 0;            //messages completed
+        size_t off = 0, ioff = 0;            //bytes moved of the current ones
+    };
+
+    std::map<int, channel> chans; //peer -> connected socket, kept with the buffers between the exchanges
+    std::vector<pollfd> pfds;
+    std::vector<channel*> owners; //channel of each of pfds
+
+    /**
+     * Sends or receives on fd until everything is moved, used during the setup
+     */
+    static void blocking(int fd, char* data, size_t bytes, bool out){
+        while(bytes > 0){
+            ssize_t k = out ? send(fd, data, bytes, MSG_NOSIGNAL) : recv(fd, data, bytes, 0);
+            if(k == 0) throw std::runtime_error("connection closed during setup");
+            if(k < 0){
+                if(errno == EINTR) continue;
+                fail("setup");
+            }
+            data += k;
+            bytes -= k;
+        }
+    }
+
+    protected:
+    /**
+     * @return a socket listening for the peers of rank
+     */
+    virtual int listenOn(int const& rank)=0;
+
+    /**
+     * @return a socket connected to peer, or -1 if the peer is not listening yet
+     */
+    virtual int connectTo(int const& peer)=0;
+
+    /**
+     * Connects to every peer, must be called by the constructor of the subclass
+     */
+    void setup(int const& rank, std::set<int> const& peers){
+        int lfd = listenOn(rank);
+        for(int p : peers){
+            if(p >= rank) continue;
+            int fd = -1;
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+            while((fd = connectTo(p)) < 0){
+                if(std::chrono::steady_clock::now() > deadline) fail("connect to " + std::to_string(p));
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            int r = rank;
+            blocking(fd, (char*)&r, sizeof(r), true);
+            chans[p].fd = fd;
+        }
+        int higher = std::count_if(peers.begin(), peers.end(), [&](int p){ return p > rank; });
+        for(int i=0; i<higher; i++){
+            int fd = accept(lfd, nullptr, nullptr);
+            if(fd < 0) fail("accept");
+            int p;
+            blocking(fd, (char*)&p, sizeof(p), false);
+            chans[p].fd = fd;
+        }
+        close(lfd);
+        for(auto& pc : chans) fcntl(pc.second.fd, F_SETFL, fcntl(pc.second.fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    public:
+    ~SocketTransport(){
+        for(auto& pc : chans) close(pc.second.fd);
+    }
+
+    void exchange(std::vector<Message> const& sends, std::vector<Message> const& recvs){
+        for(auto& pc : chans){
+            channel& c = pc.second;
+            c.out.clear();
+            c.in.clear();
+            c.nout = c.nin = c.off = c.ioff = 0;
+        }
+        for(auto& s : sends) chans.at(s.peer).out.push_back(&s);
+        for(auto& r : recvs) chans.at(r.peer).in.push_back(&r);
+        while(true){
+            //empty messages complete without touching the socket
+            for(auto& pc : chans){
+                channel& c = pc.second;
+                while(c.nout < c.out.size() && c.out[c.nout]->bytes == 0) c.nout++;
+                while(c.nin < c.in.size() && c.in[c.nin]->bytes == 0) c.nin++;
+            }
+            pfds.clear();
+            owners.clear();
+            for(auto& pc : chans){
+                channel& c = pc.second;
+                short ev = (c.nout < c.out.size() ? POLLOUT : 0) | (c.nin < c.in.size() ? POLLIN : 0);
+                if(ev == 0) continue;
+                pfds.push_back(pollfd{c.fd, ev, 0});
+                owners.push_back(&c);
+            }
+            if(pfds.empty()) return;
+            if(poll(pfds.data(), pfds.size(), -1) < 0){
+                if(errno == EINTR) continue;
+                fail("poll");
+            }
+            for(size_t i=0; i<pfds.size(); i++){
+                channel& c = *owners[i];
+                if((pfds[i].revents & (POLLOUT | POLLERR)) && c.nout < c.out.size()){
+                    const Message& m = *c.out[c.nout];
+                    ssize_t k = send(pfds[i].fd, m.data + c.off, m.bytes - c.off, MSG_NOSIGNAL);
+                    if(k < 0 && errno != EAGAIN && errno != EINTR) fail("send");
+                    if(k > 0) c.off += k;
+                    if(c.off == m.bytes){ c.nout++; c.off = 0; }
+                }
+                if((pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) && c.nin < c.in.size()){
+                    const Message& m = *c.in[c.nin];
+                    ssize_t k = recv(pfds[i].fd, m.data + c.ioff, m.bytes - c.ioff, 0);
+                    if(k == 0) throw std::runtime_error("peer closed the connection");
+                    if(k < 0 && errno != EAGAIN && errno != EINTR) fail("recv");
+                    if(k > 0) c.ioff += k;
+                    if(c.ioff == m.bytes){ c.nin++; c.ioff = 0; }
+                }
+            }
+        }
+    }
+};
+
+/**
+ * Unix domain sockets in /tmp, for processes on the same host
+ */
+class UnixTransport : public SocketTransport {
+    std::string _key;
+
+    std::string path(int const& rank){
+        return "/tmp/" + _key + "-" + std::to_string(rank) + ".sock";
+    }
+
+    sockaddr_un address(int const& rank){
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path(rank).c_str(), sizeof(addr.sun_path) - 1);
+        return addr;
+    }
+
+    protected:
+    int listenOn(int const& rank){
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd < 0) fail("socket");
+        sockaddr_un addr = address(rank);
+        unlink(addr.sun_path);
+        if(bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0) fail("bind " + path(rank));
+        if(listen(fd, SOMAXCONN) < 0) fail("listen");
+        return fd;
+    }
+
+    int connectTo(int const& peer){
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd < 0) fail("socket");
+        sockaddr_un addr = address(peer);
+        if(connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) return fd;
+        close(fd);
+        return -1;
+    }
+
+    public:
+    /**
+     * @param key name shared by the processes of the run
+     */
+    UnixTransport(int const& rank, std::set<int> const& peers, std::string const& key) : _key(key){
+        setup(rank, peers);
+        unlink(path(rank).c_str());
+    }
+};
+
+/**
+ * TCP sockets, for processes on different hosts
+ */
+class TcpTransport : public SocketTransport {
+    std::vector<std::string> _hosts; //host:port of each rank
+
+    static std::pair<std::string, std::string> split(std::string const& hp){
+        size_t colon = hp.rfind(':');
+        if(colon == std::string::npos) throw std::runtime_error("expected host:port, got " + hp);
+        return {hp.substr(0, colon), hp.substr(colon + 1)};
+    }
+
+    protected:
+    int listenOn(int const& rank){
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if(fd < 0) fail("socket");
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(std::stoi(split(_hosts[rank]).second));
+        if(bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0) fail("bind " + _hosts[rank]);
+        if(listen(fd, SOMAXCONN) < 0) fail("listen");
+        return fd;
+    }
+
+    int connectTo(int const& peer){
+        auto hp = split(_hosts[peer]);
+        addrinfo hints{}, *res = nullptr;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if(getaddrinfo(hp.first.c_str(), hp.second.c_str(), &hints, &res) != 0) return -1;
+        int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        if(fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0){
+            close(fd);
+            fd = -1;
+        }
+        freeaddrinfo(res);
+        if(fd >= 0){
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        return fd;
+    }
+
+    public:
+    /**
+     * @param hosts host:port where each rank listens
+     */
+    TcpTransport(int const& rank, std::set<int> const& peers, std::vector<std::string> const& hosts)
+        : _hosts(hosts){
+        setup(rank, peers);
+    }
+};
+
+/**
+ * POSIX shared memory with a single-producer single-consumer ring for each
+ * ordered pair of processes, for processes on the same host
+ */
+class ShmTransport : public Transport {
+    static constexpr size_t CAPACITY = 1 << 18; //bytes of each ring
+
+    struct ring {
+        alignas(64) std::atomic<uint64_t> head; //bytes consumed
+        alignas(64) std::atomic<uint64_t> tail; //bytes produced
+        alignas(64) char data[CAPACITY];
+    };
+
+    /**
+     * Messages of the current exchange with a peer, in order
+     */
+    struct queue {
+        std::vector<const Message*> msgs;
+        size_t next = 0; //message reached
+        size_t off = 0;  //bytes moved of it
+    };
+
+    int _rank;
+    int _nprocs;
+    ring* rings;
+    size_t size;
+    std::vector<queue> outs, ins; //by peer, kept with their buffers between the exchanges
+    std::vector<int> outPeers, inPeers; //peers with messages in the current exchange
+
+    inline ring& between(int const& from, int const& to){
+        return rings[size_t(from) * _nprocs + to];
+    }
+
+    /**
+     * Moves as many bytes as the ring allows
+     * @return bytes moved
+     */
+    static size_t put(ring& r, const char* data, size_t bytes){
+        uint64_t tail = r.tail.load(std::memory_order_relaxed);
+        size_t n = std::min(bytes, size_t(CAPACITY - (tail - r.head.load(std::memory_order_acquire))));
+        size_t at = tail % CAPACITY;
+        size_t first = std::min(n, CAPACITY - at);
+        memcpy(r.data + at, data, first);
+        memcpy(r.data, data + first, n - first);
+        r.tail.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    static size_t get(ring& r, char* data, size_t bytes){
+        uint64_t head = r.head.load(std::memory_order_relaxed);
+        size_t n = std::min(bytes, size_t(r.tail.load(std::memory_order_acquire) - head));
+        size_t at = head % CAPACITY;
+        size_t first = std::min(n, CAPACITY - at);
+        memcpy(data, r.data + at, first);
+        memcpy(data + first, r.data, n - first);
+        r.head.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    public:
+    /**
+     * @return name of the shared memory segment of the run
+     */
+    static std::string segment(std::string const& key){
+        return "/" + key;
+    }
+
+    /**
+     * Opens (or creates, zero filled) the segment shared by the run
+     * @param key name shared by the processes of the run
+     */
+    ShmTransport(int const& rank, int const& nprocs, std::string const& key)
+        : _rank(rank), _nprocs(nprocs), outs(nprocs), ins(nprocs){
+        size = sizeof(ring) * nprocs * nprocs;
+        int fd = shm_open(segment(key).c_str(), O_CREAT | O_RDWR, 0600);
+        if(fd < 0) fail("shm_open " + segment(key));
+        if(ftruncate(fd, size) < 0) fail("ftruncate");
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if(p == MAP_FAILED) fail("mmap");
+        rings = static_cast<ring*>(p);
+    }
+
+    ~ShmTransport(){
+        munmap(rings, size);
+    }
+
+    void exchange(std::vector<Message> const& sends, std::vector<Message> const& recvs){
+        auto plan = [](std::vector<Message> const& list, std::vector<queue>& queues, std::vector<int>& peers){
+            for(int p : peers){ //only the queues of the last exchange are not empty
+                queues[p].msgs.clear();
+                queues[p].next = queues[p].off = 0;
+            }
+            peers.clear();
+            for(auto& m : list){
+                if(queues.at(m.peer).msgs.empty()) peers.push_back(m.peer);
+                queues[m.peer].msgs.push_back(&m);
+            }
+        };
+        plan(sends, outs, outPeers);
+        plan(recvs, ins, inPeers);
+        //moves the messages of a queue as far as its ring allows
+        auto progress = [&](queue& q, bool out, bool& moved){
+            size_t done = 0;
+            while(q.next < q.msgs.size()){
+                const Message& m = *q.msgs[q.next];
+                size_t k = out ? put(between(_rank, m.peer), m.data + q.off, m.bytes - q.off)
+                               : get(between(m.peer, _rank), m.data + q.off, m.bytes - q.off);
+                q.off += k;
+                moved |= k > 0;
+                if(q.off < m.bytes) break;
+                q.next++;
+                q.off = 0;
+                done++;
+            }
+            return done;
+        };
+        size_t left = sends.size() + recvs.size();
+        int idle = 0;
+        while(left > 0){
+            bool moved = false;
+            for(int p : outPeers) left -= progress(outs[p], true, moved);
+            for(int p : inPeers) left -= progress(ins[p], false, moved);
+            if(moved) idle = 0;
+            else if(++idle > 1024) std::this_thread::yield();
+        }
+    }
+};
+
+/**
+ * Thread that runs one task at a time, used to progress the halo exchange
+ * while the interior of the block is computed
+ */
+class Background {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::function<void()> task;
+    bool pending = false;
+    bool stop = false;
+    std::exception_ptr error;
+    std::thread worker; //last, starts when everything else is initialized
+
+    void loop(){
+        std::unique_lock<std::mutex> lock(mtx);
+        while(true){
+            cv.wait(lock, [&]{ return pending || stop; });
+            if(!pending) return;
+            lock.unlock();
+            try { task(); } catch(...) { error = std::current_exception(); }
+            lock.lock();
+            pending = false;
+            cv.notify_all();
+        }
+    }
+
+    public:
+    Background() : worker([this]{ loop(); }){}
+
+    ~Background(){
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+
+    /**
+     * Starts f, the previous task must have been waited for
+     */
+    void start(std::function<void()> f){
+        std::lock_guard<std::mutex> lock(mtx);
+        task = std::move(f);
+        pending = true;
+        cv.notify_all();
+    }
+
+    /**
+     * Waits for the task to complete, rethrowing its exception if any
+     */
+    void wait(){
+        std::unique_lock<std::mutex> lock(mtx);
+        cv.wait(lock, [&]{ return !pending; });
+        if(error) std::rethrow_exception(std::exchange(error, nullptr));
+    }
+};
+
+#endif
@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <getopt.h>
+
+using namespace std;
+
+/**
+ * Configuration of a run: the backend of ca and its arguments after
+ * N M number_step
+ */
+struct config {
+    string backend;
+    vector<string> args;
+
+    string str() const {
+        string s = backend;
+        for(auto& a : args) s += " " + a;
+        return s;
+    }
+};
+
+/**
+ * Grid, boundary and rule a configuration is tuned for
+ */
+struct problem {
+    int n;
+    int m;
+    string boundary;
+    string rule; //B/S notation of the Life rule
+};
+
+/**
+ * @return the arguments running ca with the configuration
+ */
+vector<string> command(string const& dir, config const& c, problem const& p, string const& steps){
+    vector<string> args = {dir + "/ca", to_string(p.n), to_string(p.m), steps};
+    args.insert(args.end(), c.args.begin(), c.args.end());
+    args.insert(args.end(), {"--backend", c.backend, "-b", p.boundary, "--rule", p.rule});
+    return args;
+}
+
+/**
+ * Runs the backend for the given generations with the output discarded
+ * @return wall-clock seconds, infinity if the run failed
+ */
+double timeRun(string const& dir, config const& c, problem const& p, int const& steps){
+    vector<string> args = command(dir, c, p, to_string(steps));
+    vector<char*> argv;
+    for(auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+
+    auto start = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if(pid == 0){
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    if(pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return numeric_limits<double>::infinity();
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+const int MAX_STEPS = 1 << 20; //generations of the calibration at most
+
+/**
+ * Seconds per generation of the configuration: the difference between a run
+ * of 2k and one of k generations, so that the start-up and the initialization
+ * of the grid, paid once per run, are not counted. k is doubled until the
+ * difference lasts minTime, then the median of repeat trials is taken; a
+ * trial where the longer run was not slower is noise and is run again.
+ * @param k generations the calibration starts from
+ * @return infinity if the configuration fails or no trial can be measured
+ */
+double measure(string const& dir, config const& c, problem const& p,
+               int k, int const& repeat, double const& minTime){
+    auto trial = [&](){
+        double shortRun = timeRun(dir, c, p, k);
+        if(isinf(shortRun)) return shortRun;
+        return timeRun(dir, c, p, 2*k) - shortRun;
+    };
+    double diff = trial();
+    while(!isinf(diff) && diff < minTime && k < MAX_STEPS){
+        k *= 2;
+        diff = trial();
+    }
+    vector<double> samples; //seconds per generation of the valid trials
+    for(int t=0; !isinf(diff) && int(samples.size()) < repeat && t < 3*repeat; t++){
+        if(t > 0) diff = trial();
+        if(diff > 0) samples.push_back(diff / k);
+    }
+    if(isinf(diff) || samples.empty()) return numeric_limits<double>::infinity();
+    nth_element(samples.begin(), samples.begin() + samples.size()/2, samples.end());
+    return samples[samples.size()/2];
+}
+
+/**
+ * Per-host cache of the tuned configurations, one line per grid and rule:
+ * N M boundary rule backend args...
+ */
+class TuningCache {
+    string _path;
+
+    static string key(problem const& p){
+        return to_string(p.n) + " " + to_string(p.m) + " " + p.boundary + " " + p.rule;
+    }
+
+    public:
+    TuningCache(string const& path) : _path(path){}
+
+    /**
+     * Default path: $XDG_CACHE_HOME/ca-tune/<hostname>, ~/.cache if unset
+     */
+    static string defaultPath(){
+        char host[256] = "localhost";
+        gethostname(host, sizeof(host) - 1);
+        string base;
+        if(getenv("XDG_CACHE_HOME")) base = getenv("XDG_CACHE_HOME");
+        else base = string(getenv("HOME") ? getenv("HOME") : ".") + "/.cache";
+        mkdir(base.c_str(), 0755);
+        mkdir((base + "/ca-tune").c_str(), 0755);
+        return base + "/ca-tune/" + host;
+    }
+
+    bool lookup(problem const& p, config& c){
+        ifstream in(_path);
+        string line, k = key(p);
+        while(getline(in, line)){
+            if(line.compare(0, k.size() + 1, k + " ") != 0) continue;
+            stringstream ss(line.substr(k.size() + 1));
+            c = config();
+            ss >> c.backend;
+            string a;
+            while(ss >> a) c.args.push_back(a);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Replaces the entry of the grid, if any
+     */
+    void store(problem const& p, config const& c){
+        ifstream in(_path);
+        vector<string> lines;
+        string line, k = key(p);
+        while(getline(in, line)){
+            if(line.compare(0, k.size() + 1, k + " ") != 0) lines.push_back(line);
+        }
+        in.close();
+        lines.push_back(k + " " + c.str());
+        string tmp = _path + ".tmp";
+        ofstream out(tmp);
+        for(auto& l : lines) out << l << endl;
+        out.close();
+        rename(tmp.c_str(), _path.c_str());
+    }
+};
+
+/**
+ * Calibration sweep in two stages: the worker count of each backend with its
+ * default options, then the block size of each backend at its best worker
+ * count. Trying every combination would cost the product of the two.
+ */
+config tune(string const& dir, problem const& p,
+            int const& k, int const& repeat, double const& minTime, double& bestTime){
+    int hw = max(1u, thread::hardware_concurrency());
+    vector<int> workers;
+    for(int w=1; w<hw; w*=2) workers.push_back(w);
+    workers.push_back(hw);
+    //block options of each backend: tile rows or chunk rows
+    vector<pair<string, string>> blocks = {{"thread", "-t"}, {"parfor", "-c"}, {"farm", "-t"}, {"openmp", "-c"}};
+    vector<string> sizes = {"1", "8", "32", "128"};
+
+    config best{"sequential", {}};
+    bestTime = measure(dir, best, p, k, repeat, minTime);
+    cout << best.str() << ": " << bestTime * 1e6 << " usec/generation" << endl;
+    auto trial = [&](config const& c){
+        double t = measure(dir, c, p, k, repeat, minTime);
+        cout << c.str() << ": " << t * 1e6 << " usec/generation" << endl;
+        if(t < bestTime){
+            bestTime = t;
+            best = c;
+        }
+        return t;
+    };
+    for(auto& b : blocks){
+        config local;
+        double localTime = numeric_limits<double>::infinity();
+        for(int w : workers){
+            config c{b.first, {to_string(w)}};
+            double t = trial(c);
+            if(t < localTime){
+                localTime = t;
+                local = c;
+            }
+        }
+        if(localTime == numeric_limits<double>::infinity()) continue; //backend not supported
+        for(auto& s : sizes){
+            if(stoi(s) > p.n) break;
+            config c = local;
+            c.args.push_back(b.second);
+            c.args.push_back(s);
+            trial(c);
+        }
+    }
+    cout << "best: " << best.str() << " " << bestTime * 1e6 << " usec/generation" << endl;
+    return best;
+}
+
+int main(int argc, char* argv[]){
+    string boundary="torus";
+    string rule="B3/S23";
+    string dir;
+    string cachePath;
+    int k=10;
+    int repeat=3;
+    double minTime=0.2;
+    bool force=false;
+    static struct option options[] = {
+        {"boundary", required_argument, 0, 'b'},
+        {"rule", required_argument, 0, 'L'},
+        {"bindir", required_argument, 0, 'd'},
+        {"cache", required_argument, 0, 'C'},
+        {"calibration", required_argument, 0, 'k'},
+        {"repeat", required_argument, 0, 'r'},
+        {"min-time", required_argument, 0, 't'},
+        {"force", no_argument, 0, 'f'},
+        {0, 0, 0, 0}
+    };
+    bool usage=false;
+    int opt;
+    while((opt = getopt_long(argc, argv, "b:L:d:C:k:r:t:f", options, NULL)) != -1){
+        switch(opt){
+            case 'b': boundary = optarg; break;
+            case 'L': rule = optarg; break;
+            case 'd': dir = optarg; break;
+            case 'C': cachePath = optarg; break;
+            case 'k': k = atoi(optarg); break;
+            case 'r': repeat = atoi(optarg); break;
+            case 't': minTime = atof(optarg); break;
+            case 'f': force = true; break;
+            default: usage = true;
+        }
+    }
+    if(k <= 0 || repeat <= 0 || minTime <= 0) usage = true;
+    if(usage || (argc - optind != 2 && argc - optind != 3)) {
+        cout << "Usage is: " << argv[0] << " N M [number_step]"
+             << " [-b torus|fixed|reflective|open] [-L B3/S23] [-d bindir] [-C cache]"
+             << " [-k calibration_steps] [-r repeat] [-t min_seconds] [-f]" << endl
+             << "without number_step the grid is tuned and the result cached,"
+             << " with it the cached configuration is run, tuning first if missing" << endl;
+        return(-1);
+    }
+    problem p{atoi(argv[optind]), atoi(argv[optind+1]), boundary, rule};
+    if(dir.empty()){ //the backends are next to the tuner
+        string self = argv[0];
+        dir = dirname(&self[0]);
+    }
+    TuningCache cache(cachePath.empty() ? TuningCache::defaultPath() : cachePath);
+
+    config c;
+    bool tuneOnly = argc - optind == 2;
+    if(force || tuneOnly || !cache.lookup(p, c)){
+        double t;
+        c = tune(dir, p, k, repeat, minTime, t);
+        if(isinf(t)){ //nothing to cache
+            cout << "No configuration could be measured" << endl;
+            return(-1);
+        }
+        cache.store(p, c);
+    } else {
+        cout << "tuned: " << c.str() << endl;
+    }
+    if(tuneOnly) return(0);
+
+    vector<string> args = command(dir, c, p, argv[optind+2]);
+    vector<char*> cargs;
+    for(auto& a : args) cargs.push_back(const_cast<char*>(a.c_str()));
+    cargs.push_back(nullptr);
+    cout.flush();
+    execv(cargs[0], cargs.data());
+    perror("execv");
+    return(-1);
+}
@@ -0,0 +1,28 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+
+/**
+ * Prints the time elapsed from its construction to its destruction,
+ * as "<message> <usec> usec"
+ */
+class utimer {
+    std::chrono::steady_clock::time_point start;
+    std::string message;
+    long* usElapsed; //also stored here, if not null
+
+public:
+    /**
+     * @param m message printed before the time
+     * @param us where to store the elapsed usec, null to only print them
+     */
+    utimer(std::string const& m, long* us = nullptr) : start(std::chrono::steady_clock::now()), message(m), usElapsed(us) {}
+
+    ~utimer(){
+        long usec = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        std::cout << message << " " << std::setw(15) << usec << " usec" << std::endl;
+        if(usElapsed != nullptr) *usElapsed = usec;
+    }
+};